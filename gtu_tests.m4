@@ -82,10 +82,17 @@ AS_IF(ENABLED_CHECK, [
   m4_pushdef([REQ_CFLAGS], m4_join([], $REQ_FLAGS, [_CFLAGS]))
   m4_pushdef([REQ_LIBS],   m4_join([], $REQ_FLAGS, [_LIBS]))
 
-  PKG_CHECK_MODULES(REQ_FLAGS, [glib-2.0 gobject-2.0 libunwind])
+  PKG_CHECK_MODULES(REQ_FLAGS, [glib-2.0 gobject-2.0 libunwind zlib])
 
   AS_VAR_SET([gtu_U_CFLAGS], REQ_CFLAGS)
   AS_VAR_SET([gtu_U_LIBS], REQ_LIBS)
+
+  dnl GTU's own configure picks up zstd if it's there, so we have to as well
+  PKG_CHECK_MODULES([gtu_zstd_U], [libzstd], [
+    AS_VAR_APPEND([gtu_U_CFLAGS], [" $gtu_zstd_U_CFLAGS"])
+    AS_VAR_APPEND([gtu_U_LIBS], [" $gtu_zstd_U_LIBS"])
+  ], [:])
+
   AS_VAR_APPEND([gtu_U_CFLAGS], [" -I\[$](gtu_U_PATH)/include"])
   AS_VAR_APPEND([gtu_U_LIBS], [" \[$](gtu_U_PATH)/src/libgtu.a"])
   AC_SUBST([gtu_U_CFLAGS])
@@ -103,6 +103,37 @@ GtuTestCase* gtu_test_case_new (const char* name,
  */
 GtuTestCase* gtu_test_case_construct (GType type, const char* name);
 
+/**
+ * gtu_test_case_set_parallel_safe:
+ * @self:          a #GtuTestCase instance.
+ * @parallel_safe: whether @self may run at the same time as other tests.
+ *
+ * Marks @self as safe to run on a thread of its own alongside other tests
+ * marked the same way, in the same process. Consecutive parallel-safe tests
+ * are run together on a pool of `--jobs` threads; everything else still runs
+ * one test at a time, after those before it have finished. Results are
+ * reported in the usual order either way.
+ *
+ * A parallel-safe test mustn't depend on global state that other tests
+ * change. Messages logged by the other tests running alongside it, including
+ * from threads they start with gtu_thread_new(), are never matched against
+ * its expectations. This has no effect on #GtuComplexCase instances.
+ *
+ * Tests aren't parallel-safe unless marked so. This must be called before the
+ * test suite is run.
+ */
+void gtu_test_case_set_parallel_safe (GtuTestCase* self, bool parallel_safe);
+
+/**
+ * gtu_test_case_get_parallel_safe:
+ * @self: a #GtuTestCase instance.
+ *
+ * See gtu_test_case_set_parallel_safe().
+ *
+ * Returns: whether @self has been marked as parallel-safe.
+ */
+bool gtu_test_case_get_parallel_safe (GtuTestCase* self);
+
 /**
  * GtuExpectHandle:
  *
@@ -147,6 +178,110 @@ GtuExpectHandle gtu_test_case_expect_message (GtuTestCase* self,
                                               GLogLevelFlags level,
                                               GRegex* regex);
 
+/**
+ * GtuPatternKind:
+ * @GTU_PATTERN_KIND_LITERAL: the message must contain the pattern as is.
+ * @GTU_PATTERN_KIND_GLOB:    the whole message must match the pattern, where
+ *                            `*` matches any run of characters and `?` any
+ *                            single character, as with #GPatternSpec.
+ * @GTU_PATTERN_KIND_REGEX:   the message must match the pattern as a regular
+ *                            expression, as with gtu_test_case_expect_message().
+ *
+ * How gtu_test_case_expect_pattern() matches a pattern against messages.
+ */
+typedef enum {
+  GTU_PATTERN_KIND_LITERAL,
+  GTU_PATTERN_KIND_GLOB,
+  GTU_PATTERN_KIND_REGEX
+} GtuPatternKind;
+
+/**
+ * gtu_test_case_expect_pattern:
+ * @self:    #GtuTestCase that's expected to generate a message.
+ * @domain:  log domain expecting message.
+ * @level:   flags to check messages against.
+ * @pattern: what we expect the message will match.
+ * @kind:    how to interpret @pattern.
+ *
+ * Like gtu_test_case_expect_message(), but takes the pattern as a string.
+ * Literal and glob patterns are matched without involving the regex engine at
+ * all, and regexes are compiled once per process and shared between all test
+ * cases expecting the same pattern, so this is the cheaper way to set up many
+ * expectations.
+ *
+ * Returns: a handle that can be used to query the match state.
+ */
+GtuExpectHandle gtu_test_case_expect_pattern (GtuTestCase* self,
+                                              const char* domain,
+                                              GLogLevelFlags level,
+                                              const char* pattern,
+                                              GtuPatternKind kind);
+
+/**
+ * gtu_test_case_expect_field:
+ * @self:   #GtuTestCase that's expected to generate a message.
+ * @domain: log domain expecting message.
+ * @level:  flags to check messages against.
+ * @key:    name of the structured log field to check.
+ * @value:  expected value of @key.
+ *
+ * Like gtu_test_case_expect_message(), but rather than matching the text of a
+ * message, matches messages logged with g_log_structured() et al. having a
+ * field named @key whose value is exactly @value. The field is compared as is;
+ * nothing is formatted, so this is cheaper than matching a regex against the
+ * message and can't be fooled by other fields.
+ *
+ * Messages logged with g_log() have no fields and never match. Structured
+ * messages without a MESSAGE field can match too.
+ *
+ * Returns: a handle that can be used to query the match state.
+ */
+GtuExpectHandle gtu_test_case_expect_field (GtuTestCase* self,
+                                            const char* domain,
+                                            GLogLevelFlags level,
+                                            const char* key,
+                                            const char* value);
+
+/**
+ * gtu_test_case_expect_field_prefix:
+ * @self:   #GtuTestCase that's expected to generate a message.
+ * @domain: log domain expecting message.
+ * @level:  flags to check messages against.
+ * @key:    name of the structured log field to check.
+ * @prefix: expected start of the value of @key.
+ *
+ * Like gtu_test_case_expect_field(), but the value of @key need only start
+ * with @prefix.
+ *
+ * Returns: a handle that can be used to query the match state.
+ */
+GtuExpectHandle gtu_test_case_expect_field_prefix (GtuTestCase* self,
+                                                   const char* domain,
+                                                   GLogLevelFlags level,
+                                                   const char* key,
+                                                   const char* prefix);
+
+/**
+ * gtu_test_case_expect_field_range:
+ * @self:   #GtuTestCase that's expected to generate a message.
+ * @domain: log domain expecting message.
+ * @level:  flags to check messages against.
+ * @key:    name of the structured log field to check.
+ * @min:    smallest acceptable value of @key.
+ * @max:    largest acceptable value of @key.
+ *
+ * Like gtu_test_case_expect_field(), but the value of @key must be a string
+ * containing a decimal integer between @min and @max inclusive.
+ *
+ * Returns: a handle that can be used to query the match state.
+ */
+GtuExpectHandle gtu_test_case_expect_field_range (GtuTestCase* self,
+                                                  const char* domain,
+                                                  GLogLevelFlags level,
+                                                  const char* key,
+                                                  gint64 min,
+                                                  gint64 max);
+
 /**
  * gtu_test_case_expect_check:
  * @self:   a #GtuTestCase instance.
@@ -14,8 +14,21 @@
  *
  * Subunits are declared using #GEnumClass, of which the nicks are used to
  * identify subunits and values used for control flow. Subunits are guaranteed
- * to be executed in the order they're given when registered with GType, and
- * cannot be skipped individually using the command-line arguments.
+ * to be executed in the order they're given when registered with GType.
+ *
+ * Each subunit has a path of its own, made of the case's path and its nick,
+ * which the `-p` and `-s` command-line arguments apply to. Subunits left out
+ * this way don't run and aren't reported, so a subunit relying on an earlier
+ * one having run should check for itself.
+ *
+ * If the subunits don't depend on each other at all, a class can set
+ * #GtuComplexCaseClass.concurrent_subunits in its class_init function to have
+ * them run at the same time, each on a thread of its own, on up to `--jobs`
+ * threads. They are still reported in order, each after whatever it logged,
+ * and a failing subunit no longer causes those after it to be abandoned.
+ * Without `--keep-going`, a failed assert or crash still ends the run, but
+ * only once the subunits before it have been reported. The subunits share the case's expectations, so these should be set up before
+ * the suite runs rather than by the subunits themselves.
  *
  * #GtuComplexCase is an abstract class, so it cannot be used directly. You
  * should derive from #GtuComplexCase in order to create new complex test
@@ -50,6 +63,8 @@ G_DECLARE_DERIVABLE_TYPE (GtuComplexCase, gtu_complex_case, GTU, COMPLEX_CASE,
  *             on this value to ensure the expected subunit is executed on each
  *             call. This function must be implemented by derivative classes.
  *             See also #GtuTestCaseClass.test_impl and #GtuTestCaseFunc
+ * @concurrent_subunits: whether the subunits are independent of each other, so
+ *                       may run at the same time. See #GtuComplexCase.
  *
  * Abstract class for #GtuComplexCase.
  */
@@ -58,6 +73,7 @@ struct _GtuComplexCaseClass {
   GtuTestCaseClass parent_class;
   /*< public >*/
   void (*test_impl) (GtuComplexCase* self, gconstpointer subunit);
+  bool concurrent_subunits;
 };
 
 /**
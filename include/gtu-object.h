@@ -166,8 +166,9 @@ GtuTestSuite* gtu_test_object_get_parent_suite (GtuTestObject* self);
  * GtuTestObject::ancestry-changed:
  * @self: #GtuTestObject instance on which ::ancestry-changed was emitted.
  *
- * Emitted when @self's parent (or its parent's parent, etc) has been
- * (re-)parented.
+ * Emitted when @self has been added to a #GtuTestSuite. Objects further down
+ * the tree aren't notified when one of their ancestors is; paths returned by
+ * gtu_test_object_get_path() are kept up to date without it.
  */
 
 G_END_DECLS
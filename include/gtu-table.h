@@ -0,0 +1,146 @@
+#ifndef __GII_TEST_UTILS_TABLE_H__
+#define __GII_TEST_UTILS_TABLE_H__
+
+/**
+ * SECTION:gtu-table
+ * @short_description: declaring tests as static data
+ * @title: Test Tables
+ * @include: gtu.h
+ *
+ * Creating a #GtuTestCase for every test up front gets expensive for programs
+ * with many thousands of them. A test table is a constant array of tests,
+ * declared with GTU_TEST_TABLE():
+ *
+ * |[<!-- language="C" -->
+ * static void parse_empty_test (void* data) { ... }
+ * static void parse_nested_test (void* data) { ... }
+ *
+ * GTU_TEST_TABLE (parser,
+ *   { "empty",  parse_empty_test,  GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE },
+ *   { "nested", parse_nested_test, GTU_TEST_TABLE_FLAGS_NONE }
+ * );
+ *
+ * int main (int argc, char* argv[]) {
+ *   GtuTestSuite* suite;
+ *
+ *   gtu_init (argv, argc);
+ *
+ *   suite = gtu_test_suite_new ("my-project");
+ *   gtu_test_suite_add_tables (suite);
+ *
+ *   return gtu_test_suite_run (suite);
+ * }
+ * ]|
+ *
+ * Each table becomes a suite named after it, so the tests above have the paths
+ * `/my-project/parser/empty` and `/my-project/parser/nested`. Registering a
+ * table doesn't allocate anything per test: a test is only turned into a
+ * #GtuTestCase when it's about to run, and that is released again once its
+ * result has been reported. Listing tests with `-l` doesn't create any.
+ *
+ * Tables declared with GTU_TEST_TABLE() are gathered by the linker, which
+ * relies on ELF sections; elsewhere, add each table with
+ * gtu_test_suite_add_table().
+ */
+
+#ifndef __GII_TEST_UTILS_H__
+#error "Only <gtu.h> can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * GtuTestTableFlags:
+ * @GTU_TEST_TABLE_FLAGS_NONE:          No flags.
+ * @GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE: The test may run alongside others;
+ *                                      see gtu_test_case_set_parallel_safe().
+ *
+ * Flags for the tests in a #GtuTestTable.
+ */
+typedef enum {
+  GTU_TEST_TABLE_FLAGS_NONE          = 0,
+  GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE = 1 << 0
+} GtuTestTableFlags;
+
+/**
+ * GtuTestTableEntry:
+ * @name:  the test's name, which must be a valid #GtuPath element as per
+ *         #Validity and unique within the table.
+ * @func:  function implementing the test. Its argument is the #GtuTestCase
+ *         made for it, so tests can set up expectations with, for example,
+ *         gtu_test_case_expect_message().
+ * @flags: a combination of #GtuTestTableFlags.
+ *
+ * A single test in a #GtuTestTable.
+ */
+typedef struct {
+  const char*       name;
+  GtuTestCaseFunc   func;
+  GtuTestTableFlags flags;
+} GtuTestTableEntry;
+
+/**
+ * GtuTestTable:
+ * @name:      name of the suite the table becomes, which must be a valid
+ *             #GtuPath element as per #Validity.
+ * @entries:   (array length=n_entries): the tests, in the order they run.
+ * @n_entries: the number of elements in @entries.
+ *
+ * A constant array of tests. These are usually declared with GTU_TEST_TABLE().
+ */
+typedef struct {
+  const char*              name;
+  const GtuTestTableEntry* entries;
+  size_t                   n_entries;
+} GtuTestTable;
+
+#if defined (__GNUC__) && defined (__ELF__)
+# define _GTU_TEST_TABLE_LINK                                    \
+  __attribute__ ((section ("gtu_test_tables"), used))
+#else
+# define _GTU_TEST_TABLE_LINK G_GNUC_UNUSED
+#endif
+
+/**
+ * GTU_TEST_TABLE:
+ * @name: an identifier, used both as the name of the #GtuTestTable declared
+ *        and as the name of the suite it becomes.
+ * @...:  the table's #GtuTestTableEntry initialisers.
+ *
+ * Declares a static #GtuTestTable called @name, which is added to a suite
+ * along with every other table in the program by gtu_test_suite_add_tables().
+ */
+#define GTU_TEST_TABLE(name, ...)                                       \
+  static const GtuTestTableEntry name ## _gtu_entries[] = {             \
+    __VA_ARGS__                                                         \
+  };                                                                    \
+  static const GtuTestTable name = {                                    \
+    #name, name ## _gtu_entries, G_N_ELEMENTS (name ## _gtu_entries)    \
+  };                                                                    \
+  static const GtuTestTable* const name ## _gtu_link                    \
+    _GTU_TEST_TABLE_LINK = &name
+
+/**
+ * gtu_test_suite_add_table:
+ * @self:  test suite to which @table will be added.
+ * @table: a table of tests, which must stay valid for as long as @self is
+ *         alive.
+ *
+ * Adds a child suite to @self named after @table, holding @table's tests. See
+ * #GtuTestTable.
+ */
+void gtu_test_suite_add_table (GtuTestSuite* self, const GtuTestTable* table);
+
+/**
+ * gtu_test_suite_add_tables:
+ * @self: test suite to which the tables will be added.
+ *
+ * Adds every table in the program declared with GTU_TEST_TABLE() to @self, as
+ * with gtu_test_suite_add_table(). The linker doesn't keep them in any
+ * particular order, so they're added sorted by name.
+ */
+void gtu_test_suite_add_tables (GtuTestSuite* self);
+
+G_END_DECLS
+
+#endif
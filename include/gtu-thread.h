@@ -0,0 +1,61 @@
+#ifndef __GII_TEST_UTILS_THREAD_H__
+#define __GII_TEST_UTILS_THREAD_H__
+
+/**
+ * SECTION:gtu-thread
+ * @short_description: helper threads within tests
+ * @title: Threads
+ * @include: gtu.h
+ *
+ * Each thread keeps track of the test it's running, so the checks in
+ * <xref linkend="gtu-Asserts" endterm="gtu-Asserts.top_of_page"/> and
+ * <xref linkend="gtu-Skips" endterm="gtu-Skips.top_of_page"/> work from any
+ * thread started with gtu_thread_new() while a test is running.
+ *
+ * A failing assert (or an unexpected warning, see #Logging) on such a thread
+ * marks the test that started it as failed and ends the thread early, as
+ * though its function had returned %NULL. The first thread to fail decides
+ * the outcome of the test. The thread running the test learns of this the
+ * next time it calls gtu_thread_join(), which backs out of the test rather
+ * than returning.
+ *
+ * Threads must be joined before the test that started them finishes.
+ * Messages logged from threads that weren't started with gtu_thread_new() are
+ * handled by GLib as they would be outside of a test.
+ */
+
+#ifndef __GII_TEST_UTILS_H__
+#error "Only <gtu.h> can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * gtu_thread_new:
+ * @name: (allow-none): name for the new thread, as with g_thread_new().
+ * @func: function to execute in the new thread.
+ * @data: argument to pass to @func.
+ *
+ * Like g_thread_new(), but the new thread takes part in the test running on
+ * the calling thread, if there is one.
+ *
+ * Returns: (transfer full): the new #GThread.
+ */
+GThread* gtu_thread_new (const char* name, GThreadFunc func, void* data);
+
+/**
+ * gtu_thread_join:
+ * @thread: (transfer full): a #GThread started with gtu_thread_new().
+ *
+ * Like g_thread_join(), except that if the test has been failed or skipped by
+ * another thread in the meantime, the test is aborted instead of returning to
+ * the caller.
+ *
+ * Returns: the value returned by the thread's function, or %NULL if it was
+ *          ended early.
+ */
+void* gtu_thread_join (GThread* thread);
+
+G_END_DECLS
+
+#endif
@@ -34,9 +34,11 @@
 #include "gtu-case.h"
 #include "gtu-complex.h"
 #include "gtu-suite.h"
+#include "gtu-table.h"
 
 #include "gtu-asserts.h"
 #include "gtu-skips.h"
+#include "gtu-thread.h"
 
 G_BEGIN_DECLS
 
@@ -1,10 +1,12 @@
 #include "gtu-priv.h"
 
-GtuTestModeFlags gtu_test_mode_flags_get_flags (void) {
+/* the flags can't change after g_test_init(), so we only ask GLib once */
+static GtuTestModeFlags mode_flags = 0;
+
+void _gtu_test_mode_flags_resolve (void) {
   GtuTestModeFlags flags = 0;
 
-  /* the flags are set at initialisation */
-  g_return_val_if_fail (gtu_has_initialized (), 0);
+  g_assert (g_test_initialized ());
 
   if (g_test_perf ())
     flags |= GTU_TEST_MODE_FLAGS_PERF;
@@ -41,7 +43,14 @@ GtuTestModeFlags gtu_test_mode_flags_get_flags (void) {
               (flags & GTU_TEST_MODE_FLAGS_QUIET)   == 0);
   }
 
-  return flags;
+  mode_flags = flags;
+}
+
+GtuTestModeFlags gtu_test_mode_flags_get_flags (void) {
+  /* the flags are set at initialisation */
+  g_return_val_if_fail (gtu_has_initialized (), 0);
+
+  return mode_flags;
 }
 
 bool _gtu_should_log (GLogLevelFlags log_level) {
@@ -55,11 +64,11 @@ bool _gtu_should_log (GLogLevelFlags log_level) {
       return true;
 
     case G_LOG_LEVEL_MESSAGE:
-      return !(gtu_test_mode_flags_get_flags () & GTU_TEST_MODE_FLAGS_QUIET);
+      return !(mode_flags & GTU_TEST_MODE_FLAGS_QUIET);
 
     case G_LOG_LEVEL_INFO:
     case G_LOG_LEVEL_DEBUG:
-      return gtu_test_mode_flags_get_flags () & GTU_TEST_MODE_FLAGS_VERBOSE;
+      return mode_flags & GTU_TEST_MODE_FLAGS_VERBOSE;
 
     default:
       g_assert_not_reached ();
@@ -9,6 +9,8 @@
 #undef G_DISABLE_ASSERT
 #include "gtu.h"
 
+#include "log/logio.h"
+
 /* g_abort() doesn't exist before 2.50 */
 #if GLIB_VERSION_MAX_ALLOWED < GLIB_VERSION_2_50
 # define g_abort() abort ()
@@ -24,6 +26,10 @@ G_GNUC_INTERNAL GtuDebugFlags _gtu_debug_flags_get (void);
 /* whether we should bail out if a test fails */
 G_GNUC_INTERNAL extern bool _gtu_keep_going;
 
+/* queries GLib for the test mode flags; must be called once g_test_init() has
+   been */
+G_GNUC_INTERNAL void _gtu_test_mode_flags_resolve (void);
+
 G_GNUC_INTERNAL bool _gtu_should_log (GLogLevelFlags flags);
 
 G_GNUC_INTERNAL void _gtu_test_object_set_parent_suite (GtuTestObject* self,
@@ -32,11 +38,48 @@ G_GNUC_INTERNAL void _gtu_test_object_set_parent_suite (GtuTestObject* self,
 G_GNUC_INTERNAL GtuTestObject* _gtu_test_object_construct (GType type,
                                                            const char* name);
 
-/* defined in test-suite.c for access to test suite private data */
-G_GNUC_INTERNAL void _gtu_test_object_collect_tests (GtuTestObject* object,
-                                                     GPtrArray* tests);
+G_GNUC_INTERNAL GQuark _gtu_test_object_get_name_quark (GtuTestObject* self);
+
+/* -p and -s arguments, compiled into an automaton over path elements; see
+   selector.c */
+typedef struct _GtuSelectorNode GtuSelectorNode;
 
-G_GNUC_INTERNAL void _gtu_test_object_emit_ancestry_signal (GtuTestObject* obj);
+/* Where we've got to in the automaton walking down a path one element at a
+   time. Once `state' is NULL, nothing further down the path can change
+   whether it should run. */
+typedef struct {
+  const struct _GtuSelectorState* state;
+  bool selected;
+  bool skipped;
+} GtuSelectorCursor;
+
+G_GNUC_INTERNAL void _gtu_selector_cursor_init (GtuSelectorCursor* cursor);
+G_GNUC_INTERNAL void _gtu_selector_cursor_step (GtuSelectorCursor* cursor,
+                                                GQuark element);
+/* for names which might never have been interned */
+G_GNUC_INTERNAL void _gtu_selector_cursor_step_name (GtuSelectorCursor* cursor,
+                                                     const char* name);
+G_GNUC_INTERNAL bool _gtu_selector_cursor_should_run (
+  const GtuSelectorCursor* cursor
+);
+
+/* A test to be run, in the order they're run in. Tests from a table aren't
+   given a GtuTestCase until they're about to run. */
+typedef struct {
+  GtuTestCase*             test_case; /* NULL for a table's test */
+  GtuTestSuite*            table;     /* the suite holding `entry' */
+  const GtuTestTableEntry* entry;
+  bool                     selected;  /* by -p and -s */
+} GtuCollectedTest;
+
+/* Defined in test-suite.c for access to test suite private data. `cursor'
+   points at the parent of `object', and is used to mark each test with
+   whether it was selected to run. `tests' is an array of GtuCollectedTest. */
+G_GNUC_INTERNAL void _gtu_test_object_collect_tests (
+  GtuTestObject* object,
+  const GtuSelectorCursor* cursor,
+  GArray* tests
+);
 
 /* sink without incrementing the ref count */
 G_GNUC_INTERNAL void* _gtu_test_object_sink (void* instance);
@@ -48,25 +91,59 @@ typedef enum {
   GTU_TEST_RESULT_FAIL
 } GtuTestResult;
 
-/* message may be NULL */
+/* message and details may be NULL */
 G_GNUC_INTERNAL GtuTestResult _gtu_test_case_run (GtuTestCase* self,
-                                                  char** message);
+                                                  char** message,
+                                                  GtuLogTestDetails* details);
 
 G_GNUC_INTERNAL bool _gtu_test_case_has_run (GtuTestCase* self);
 
+/* makes a test case for one of `parent's table's tests; `parent' doesn't
+   hold a reference to it */
+G_GNUC_INTERNAL GtuTestCase*
+_gtu_test_case_new_for_entry (GtuTestSuite* parent,
+                              const GtuTestTableEntry* entry);
+
+/* the number of subunits that will run */
 G_GNUC_INTERNAL unsigned _gtu_complex_case_get_length (GtuComplexCase* self);
 
+/* Decides which subunits run, with `cursor' pointing at `self'. Returns
+   whether any of them do. */
+G_GNUC_INTERNAL bool
+_gtu_complex_case_select_subunits (GtuComplexCase* self,
+                                   const GtuSelectorCursor* cursor);
+
 typedef struct {
-  GList* path_selectors;
-  GList* path_skippers;
+  GtuSelectorNode* path_selectors; /* NULL if there are no -p or -s args */
+  bool has_path_selectors;         /* whether there are -p args */
   bool list_only;
+  unsigned n_jobs; /* 0 means one per processor */
 } GtuTestMode;
 
 G_GNUC_INTERNAL GtuTestMode* _gtu_get_test_mode (void);
 
 G_GNUC_INTERNAL bool _gtu_path_element_is_valid (const char* element);
 
-/* checks `path' against command line arguments */
-G_GNUC_INTERNAL bool _gtu_path_should_run (const GtuPath* path);
+G_GNUC_INTERNAL void _gtu_path_append_quark (GtuPath* path, GQuark element);
+
+/* Makes a persistent path sharing its elements with `parent' (which may be
+   NULL), plus `element'. Persistent paths can't be modified. */
+G_GNUC_INTERNAL GtuPath* _gtu_path_new_child (const GtuPath* parent,
+                                              GQuark element);
+
+G_GNUC_INTERNAL const GtuPath* _gtu_path_get_parent (const GtuPath* path);
+
+G_GNUC_INTERNAL GtuPath* _gtu_path_ref (GtuPath* path);
+G_GNUC_INTERNAL void _gtu_path_unref (GtuPath* path);
+
+/* Adds a -p (or with `skip', -s) argument to `test_mode'; `selector' needn't
+   be nul-terminated. If it's invalid, `endptr' is left just past where the
+   problem is and `error' may say what it was. */
+G_GNUC_INTERNAL bool _gtu_selector_add (GtuTestMode* test_mode,
+                                        const char* selector,
+                                        size_t length,
+                                        bool skip,
+                                        const char** endptr,
+                                        GError** error);
 
 #endif
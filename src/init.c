@@ -4,6 +4,7 @@
 
 #include "log/logio.h"
 #include "log/log-hooks.h"
+#include "log/log-glib.h"
 
 /* needed for _gtu_test_preempt declaration */
 #include "test-case/priv-setjmp.h"
@@ -24,6 +25,9 @@ void *alloca (size_t);
 
 #define GTU_DEBUG "GTU_DEBUG"
 
+/* how much captured output we keep in memory before using a temporary file */
+#define DEFAULT_CAPTURE_LIMIT (1 << 20)
+
 static const GDebugKey _debug_keys[] = {
   { "fatal-asserts", GTU_DEBUG_FLAGS_FATAL_ASSERTS }
 };
@@ -43,9 +47,10 @@ bool gtu_has_initialized (void) {
 }
 
 static GtuTestMode _test_mode = {
-  NULL, /* path_selectors */
-  NULL, /* path_skippers */
-  false /* list_only */
+  NULL,  /* path_selectors */
+  false, /* has_path_selectors */
+  false, /* list_only */
+  0      /* n_jobs */
 };
 
 GtuTestMode* _gtu_get_test_mode (void) {
@@ -78,20 +83,89 @@ static char* get_arg (char** args, int args_length, int i, const char* arg) {
    get_arg (args, args_length, i, argstr) : \
    get_arg (args, args_length, i, argstr "="))
 
-#define CHECK_PATH(arg) G_STMT_START {                                       \
-  if (arg_path == NULL) {                                                    \
-    fprintf (stderr, "Error: invalid path specification:\n");                \
-    fprintf (stderr, "    %s\n", GET_ARG (arg));                             \
-    fprintf (stderr, "    %*s^\n", (int) (endptr - GET_ARG (arg)) - 1, " "); \
-    exit (1);                                                                \
-  }                                                                          \
-} G_STMT_END
+static void bad_selector (const char* where,
+                          const char* selector,
+                          size_t length,
+                          const char* endptr,
+                          GError* error)
+{
+  fprintf (stderr, "Error: invalid path specification%s%s%s%s:\n",
+           where != NULL ? " at " : "", where != NULL ? where : "",
+           error != NULL ? ": " : "", error != NULL ? error->message : "");
+  fprintf (stderr, "    %.*s\n", (int) length, selector);
+  fprintf (stderr, "    %*s^\n", (int) (endptr - selector) - 1, " ");
+  exit (1);
+}
+
+static void add_selector (const char* selector, bool skip) {
+  const char* endptr;
+  GError* error = NULL;
+
+  if (!_gtu_selector_add (&_test_mode, selector, strlen (selector), skip,
+                          &endptr, &error))
+  {
+    bad_selector (NULL, selector, strlen (selector), endptr, error);
+  }
+}
+
+/* for --select-from and --skip-from: one selector per line, read straight
+   out of the mapped file */
+static void add_selectors_from (const char* filename, bool skip) {
+  GError* error = NULL;
+  GMappedFile* file = g_mapped_file_new (filename, false, &error);
+  const char* line;
+  const char* end;
+  unsigned line_number = 0;
+
+  if (file == NULL) {
+    fprintf (stderr, "Error: couldn't read %s: %s\n",
+             filename, error->message);
+    exit (1);
+  }
+
+  line = g_mapped_file_get_contents (file);
+  end = line + g_mapped_file_get_length (file);
+
+  while (line < end) {
+    const char* line_end = memchr (line, '\n', end - line);
+    const char* next_line;
+    const char* endptr;
+    size_t length;
+
+    if (line_end == NULL)
+      line_end = end;
+
+    next_line = line_end + 1;
+    line_number++;
+
+    if (line_end > line && line_end[-1] == '\r')
+      line_end--;
+
+    length = line_end - line;
+
+    if (length > 0 &&
+        !_gtu_selector_add (&_test_mode, line, length, skip, &endptr, &error))
+    {
+      char* where = g_strdup_printf ("%s:%u", filename, line_number);
+      bad_selector (where, line, length, endptr, error);
+    }
+
+    line = next_line;
+  }
+
+  g_mapped_file_unref (file);
+}
 
 static void parse_args (char** args, int args_length,
                         bool* out_tap_set,
                         bool* out_fatal_warnings)
 {
   int i;
+  bool tap13 = false;
+  bool capture_log = false;
+  bool log_summary = false;
+  const char* log_file = NULL;
+  size_t capture_limit = DEFAULT_CAPTURE_LIMIT;
 
   *out_tap_set = false;
   *out_fatal_warnings = false;
@@ -108,28 +182,70 @@ static void parse_args (char** args, int args_length,
     } else if (strcmp (args[i], "--tap") == 0) {
       *out_tap_set = true;
 
+    } else if (strcmp (args[i], "--tap13") == 0) {
+      tap13 = true;
+
     } else if (strcmp (args[i], "--g-fatal-warnings") == 0) {
       *out_fatal_warnings = true;
 
-    } else if (GET_ARG ("-p")) {
+    } else if (strcmp (args[i], "--catch-crashes") == 0) {
+      _gtu_crash_guard_enable ();
+
+    } else if (strcmp (args[i], "--capture-log") == 0) {
+      capture_log = true;
+
+    } else if (GET_ARG ("--capture-log-limit")) {
       char* endptr;
-      GtuPath* arg_path = gtu_path_new_parse (GET_ARG ("-s"), &endptr);
+      const char* limit = GET_ARG ("--capture-log-limit");
 
-      CHECK_PATH ("-p");
+      capture_limit = g_ascii_strtoull (limit, &endptr, 10);
 
-      _test_mode.path_selectors = g_list_prepend (
-        _test_mode.path_selectors, arg_path
-      );
+      if (endptr == limit || *endptr != '\0') {
+        fprintf (stderr, "Error: invalid capture limit: %s\n", limit);
+        exit (1);
+      }
 
-    } else if (GET_ARG ("-s")) {
+    } else if (GET_ARG ("--log-file")) {
+      log_file = GET_ARG ("--log-file");
+
+    } else if (strcmp (args[i], "--log-summary") == 0) {
+      log_summary = true;
+
+    } else if (GET_ARG ("--log-budget")) {
+      char* endptr;
+      const char* budget = GET_ARG ("--log-budget");
+      guint64 value = g_ascii_strtoull (budget, &endptr, 10);
+
+      if (endptr == budget || *endptr != '\0' || value > G_MAXUINT) {
+        fprintf (stderr, "Error: invalid log budget: %s\n", budget);
+        exit (1);
+      }
+
+      gtu_log_g_set_line_budget ((unsigned) value);
+
+    } else if (GET_ARG ("--jobs") || GET_ARG ("-j")) {
       char* endptr;
-      GtuPath* arg_path = gtu_path_new_parse (GET_ARG ("-s"), &endptr);
+      const char* jobs = GET_ARG ("--jobs") ? GET_ARG ("--jobs") : GET_ARG ("-j");
+      guint64 value = g_ascii_strtoull (jobs, &endptr, 10);
+
+      if (endptr == jobs || *endptr != '\0' || value > G_MAXINT) {
+        fprintf (stderr, "Error: invalid number of jobs: %s\n", jobs);
+        exit (1);
+      }
+
+      _test_mode.n_jobs = (unsigned) value;
+
+    } else if (GET_ARG ("-p")) {
+      add_selector (GET_ARG ("-p"), false);
+
+    } else if (GET_ARG ("-s")) {
+      add_selector (GET_ARG ("-s"), true);
 
-      CHECK_PATH ("-s");
+    } else if (GET_ARG ("--select-from")) {
+      add_selectors_from (GET_ARG ("--select-from"), false);
 
-      _test_mode.path_skippers = g_list_prepend (
-        _test_mode.path_skippers, arg_path
-      );
+    } else if (GET_ARG ("--skip-from")) {
+      add_selectors_from (GET_ARG ("--skip-from"), true);
 
     } else if (strcmp (args[i], "-l") == 0) {
       _test_mode.list_only = true;
@@ -143,6 +259,23 @@ static void parse_args (char** args, int args_length,
     }
   }
 
+  if (log_file != NULL) {
+    GError* error = NULL;
+
+    if (!gtu_log_open_file (log_file, log_summary, &error)) {
+      fprintf (stderr, "Error: could not open log file %s: %s\n",
+               log_file, error->message);
+      exit (1);
+    }
+  }
+
+  /* the version line must come before anything else is logged */
+  if (tap13 && !_test_mode.list_only)
+    gtu_log_enable_yaml ();
+
+  if (capture_log)
+    gtu_log_capture_enable (capture_limit);
+
   /* this shouldn't necessarily be fatal, so just log */
   if (!*out_tap_set && !_test_mode.list_only)
     gtu_log_diagnostic ("WARNING: non-TAP test logging is unsupported. "
@@ -165,6 +298,22 @@ GtuLogAction verbosity_handler (GtuLogGMessage* message, void* data) {
     GTU_LOG_ACTION_IGNORE;
 }
 
+/* whatever verbosity_handler() would throw away anyway */
+static GLogLevelFlags droppable_levels (void) {
+  GLogLevelFlags ret = 0;
+
+  if (!_gtu_should_log (G_LOG_LEVEL_MESSAGE))
+    ret |= G_LOG_LEVEL_MESSAGE;
+
+  if (!_gtu_should_log (G_LOG_LEVEL_INFO))
+    ret |= G_LOG_LEVEL_INFO;
+
+  if (!_gtu_should_log (G_LOG_LEVEL_DEBUG))
+    ret |= G_LOG_LEVEL_DEBUG;
+
+  return ret;
+}
+
 void gtu_init (char** args, int args_length) {
   bool tap_set = false,
        fatal_warnings = false;
@@ -227,7 +376,10 @@ void gtu_init (char** args, int args_length) {
      *     test is treated as though it had failed an assert (marked as failed
      *     and stopped) */
 
+    _gtu_test_mode_flags_resolve ();
+
     gtu_log_hooks_init (fatal_warnings, GTU_LOG_DOMAIN, &_gtu_test_preempt);
+    gtu_log_g_set_droppable_levels (droppable_levels ());
     gtu_log_hooks_push (&verbosity_handler, NULL);
 
     _has_initialized = true;
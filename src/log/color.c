@@ -4,6 +4,7 @@
 
 #include "priv.h"
 #include "log-color.h"
+#include "log-sink.h"
 
 #if !STRUCTURED_LOGGING_AVAILABLE
 # include <unistd.h>
@@ -25,6 +26,10 @@ bool gtu_log_supports_color (void) {
     is_tty = isatty (fileno (stdout));
 #endif
 
+    /* escape codes have no business in a log file */
+    if (gtu_log_sink_is_open ())
+      is_tty = false;
+
     result = is_tty ? +1 : -1;
     g_once_init_leave (&supported, result);
   }
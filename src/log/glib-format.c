@@ -36,9 +36,45 @@ static const char* level_to_string (GLogLevelFlags log_level) {
   }
 }
 
-void gtu_log_g_format_message_append (GString* string,
-                                      const GtuLogGMessage* message)
+static unsigned level_index (GLogLevelFlags log_level) {
+  switch (log_level & G_LOG_LEVEL_MASK) {
+    case G_LOG_LEVEL_ERROR:     return 0;
+    case G_LOG_LEVEL_CRITICAL:  return 1;
+    case G_LOG_LEVEL_WARNING:   return 2;
+    case G_LOG_LEVEL_MESSAGE:   return 3;
+    case G_LOG_LEVEL_INFO:      return 4;
+    case G_LOG_LEVEL_DEBUG:     return 5;
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+#define N_LEVELS (6)
+
+typedef struct {
+  char*  str;
+  size_t length;
+} Prefix;
+
+/* Every prefix a domain has needed so far, indexed by level_index() and then
+   by whether the message was fatal. Prefixes are rendered on first use and
+   kept for the life of the process; there are only so many domains. */
+typedef struct {
+  Prefix prefixes[N_LEVELS][2];
+} DomainPrefixes;
+
+/* Maps interned domain names to DomainPrefixes. Messages without a domain use
+   `no_domain' instead. */
+G_LOCK_DEFINE_STATIC (prefix_cache);
+static GHashTable* prefix_cache = NULL;
+static DomainPrefixes no_domain;
+
+static void render_prefix (Prefix* prefix,
+                           const char* domain,
+                           GLogLevelFlags flags)
 {
+  GString* string;
   const char *fatal_color_begin = "",
              *fatal_level = "",
              *fatal_color_end = "",
@@ -47,44 +83,96 @@ void gtu_log_g_format_message_append (GString* string,
              *domain_str  = "",
              *domain_tail = "";
 
-  if (message->flags & G_LOG_FLAG_FATAL) {
+  if (flags & G_LOG_FLAG_FATAL) {
     fatal_color_begin = gtu_log_lookup_color (level_color (G_LOG_LEVEL_ERROR));
     fatal_level = "FATAL";
     fatal_color_end = gtu_log_lookup_color (GTU_LOG_COLOR_DISABLE);
     fatal_sep = "-";
   }
 
-  if (message->domain != NULL && message->domain[0] != '\0') {
+  if (domain != NULL) {
     domain_head = "(**";
-    domain_str = message->domain;
+    domain_str = domain;
     domain_tail = ") ";
   }
 
+  string = g_string_new (NULL);
   g_string_append_printf (
     string,
-    "%s%s%s%s%s%s%s: %s%s%s%s",
+    "%s%s%s%s%s%s%s: %s%s%s",
     fatal_color_begin,
     fatal_level,
     fatal_color_end,
     fatal_sep,
 
-    gtu_log_lookup_color (level_color (message->flags)),
-    level_to_string (message->flags),
+    gtu_log_lookup_color (level_color (flags)),
+    level_to_string (flags),
     gtu_log_lookup_color (GTU_LOG_COLOR_DISABLE),
 
     domain_head,
     domain_str,
-    domain_tail,
-
-    message->body
+    domain_tail
   );
+
+  prefix->length = string->len;
+  prefix->str = g_string_free (string, false);
+}
+
+static const Prefix* lookup_prefix (const char* domain, GLogLevelFlags flags) {
+  DomainPrefixes* domain_prefixes;
+  Prefix* prefix;
+
+  if (domain != NULL && domain[0] == '\0')
+    domain = NULL;
+
+  G_LOCK (prefix_cache);
+
+  if (domain == NULL) {
+    domain_prefixes = &no_domain;
+
+  } else {
+    if (prefix_cache == NULL)
+      prefix_cache = g_hash_table_new (&g_str_hash, &g_str_equal);
+
+    domain_prefixes = g_hash_table_lookup (prefix_cache, domain);
+
+    if (domain_prefixes == NULL) {
+      domain = g_intern_string (domain);
+      domain_prefixes = g_new0 (DomainPrefixes, 1);
+      g_hash_table_insert (prefix_cache, (char*) domain, domain_prefixes);
+    }
+  }
+
+  prefix = &domain_prefixes->prefixes[level_index (flags)]
+                                     [(flags & G_LOG_FLAG_FATAL) ? 1 : 0];
+
+  if (prefix->str == NULL)
+    render_prefix (prefix, domain, flags);
+
+  G_UNLOCK (prefix_cache);
+
+  return prefix;
+}
+
+void gtu_log_g_format_message_append (GString* string,
+                                      const GtuLogGMessage* message)
+{
+  const Prefix* prefix = lookup_prefix (message->domain, message->flags);
+
+  g_string_append_len (string, prefix->str, (gssize) prefix->length);
+
+  /* structured messages needn't have a MESSAGE field */
+  if (message->body != NULL)
+    g_string_append (string, message->body);
+  else
+    g_string_append (string, "(no message)");
 }
 
 char* gtu_log_g_format_message (const char* domain,
                                 GLogLevelFlags level,
                                 const char* message)
 {
-  GtuLogGMessage g_message = { domain, level, message };
+  GtuLogGMessage g_message = { domain, level, message, NULL, 0 };
   GString* ret = g_string_new (NULL);
   gtu_log_g_format_message_append (ret, &g_message);
   return g_string_free (ret, false);
@@ -19,33 +19,283 @@ static const GDebugKey glib_debug_keys[] = {
 
 static GLogLevelFlags fatal_mask;
 
-#define SHOULD_SUPPRESS(domain, level, message) \
-  (should_suppress ((domain), &(level), (message)))
+/* Consecutive identical messages are collapsed into a single repeat count, and
+   at most `line_budget' messages are printed per test (0 means no limit).
+   Threads running a test alongside others keep their own count in
+   `thread_repeats'; everyone else shares `shared_repeats'. All of them are
+   protected by the repeats lock. */
+typedef struct {
+  char*          domain;
+  GString*       body;
+  unsigned       body_hash;
+  GLogLevelFlags level;
+  bool           printed;
+
+  unsigned       n_repeats;
+  unsigned       n_printed;
+  unsigned       n_dropped;
+} Repeats;
+
+G_LOCK_DEFINE_STATIC (repeats);
+static Repeats shared_repeats = { NULL, NULL, 0, 0, false, 0, 0, 0 };
+static GPrivate thread_repeats = G_PRIVATE_INIT (NULL);
+static unsigned line_budget = 0;
+
+/* Levels in `droppable_levels' are thrown away before anything else looks at
+   them, unless a domain has registered an interest. Each domain in `table'
+   maps to an Interest; `n_interests' counts registrations across all of them
+   so that when there are none we needn't take the lock. */
+typedef struct {
+  unsigned       counts[G_LOG_LEVEL_USER_SHIFT];
+  GLogLevelFlags levels;
+} Interest;
+
+static GLogLevelFlags droppable_levels = 0;
+
+G_LOCK_DEFINE_STATIC (interests);
+static struct {
+  GHashTable*  table;
+  volatile int n_interests;
+} interests = { NULL, 0 };
+
+#define SHOULD_SUPPRESS(domain, level, message, fields, n_fields) \
+  (should_suppress ((domain), &(level), (message), (fields), (n_fields)))
 
 static bool should_suppress (const char* domain,
                              GLogLevelFlags* level,
-                             const char* message)
+                             const char* message,
+                             const GLogField* fields,
+                             size_t n_fields)
 {
   bool ret;
-  GtuLogGMessage g_message = { domain, *level, message };
-
-  /* TODO: hold read locks. The suppression mechanism is exclusively for the
-     benefit of GtuTestCase, which does all sorts of nasty stack unwinding
-     trickery. If we naively lock the mutex, GtuTestCase will destroy our
-     internal state. */
-
-  /* G_LOCK (suppress_info); */
+  GtuLogGMessage g_message = { domain, *level, message, fields, n_fields };
 
+  /* No locks: the suppression mechanism is exclusively for the benefit of
+     GtuTestCase, which does all sorts of nasty stack unwinding trickery and
+     would leave a held mutex behind. suppress_info is only written once at
+     start-up, and the hook dispatcher installed there doesn't lock either. */
   ret = suppress_info.func != NULL ?
     suppress_info.func (&g_message, (void*) suppress_info.data) :
     false;
 
-  /* G_UNLOCK (suppress_info); */
-
   *level = g_message.flags;
   return ret;
 }
 
+static bool domain_wants (const char* domain, GLogLevelFlags level) {
+  Interest* interest;
+  bool ret = false;
+
+  if (domain == NULL)
+    return false;
+
+  G_LOCK (interests);
+
+  interest = interests.table != NULL ?
+    g_hash_table_lookup (interests.table, domain) :
+    NULL;
+
+  if (interest != NULL)
+    ret = (interest->levels & level) != 0;
+
+  G_UNLOCK (interests);
+
+  return ret;
+}
+
+/* The first thing the handlers check: a couple of bit tests for a message
+   nobody is going to see, such as debug output in a non-verbose run. */
+static inline bool should_drop (const char* domain, GLogLevelFlags level) {
+  if ((level & G_LOG_FLAG_FATAL) || (level & droppable_levels) == 0)
+    return false;
+
+  if (g_atomic_int_get (&interests.n_interests) == 0)
+    return true;
+
+  return !domain_wants (domain, level);
+}
+
+void gtu_log_g_set_droppable_levels (GLogLevelFlags levels) {
+  droppable_levels = levels & G_LOG_LEVEL_MASK;
+}
+
+void gtu_log_g_add_interest (const char* domain, GLogLevelFlags levels) {
+  Interest* interest;
+  int i;
+
+  g_return_if_fail (domain != NULL);
+
+  G_LOCK (interests);
+
+  if (interests.table == NULL)
+    interests.table = g_hash_table_new (&g_str_hash, &g_str_equal);
+
+  interest = g_hash_table_lookup (interests.table, domain);
+
+  if (interest == NULL) {
+    interest = g_new0 (Interest, 1);
+    g_hash_table_insert (interests.table,
+                         (char*) g_intern_string (domain),
+                         interest);
+  }
+
+  for (i = 0; i < G_LOG_LEVEL_USER_SHIFT; i++) {
+    if ((levels & (1 << i)) && interest->counts[i]++ == 0)
+      interest->levels |= 1 << i;
+  }
+
+  g_atomic_int_inc (&interests.n_interests);
+
+  G_UNLOCK (interests);
+}
+
+void gtu_log_g_remove_interest (const char* domain, GLogLevelFlags levels) {
+  Interest* interest;
+  int i;
+
+  g_return_if_fail (domain != NULL);
+
+  G_LOCK (interests);
+
+  interest = interests.table != NULL ?
+    g_hash_table_lookup (interests.table, domain) :
+    NULL;
+
+  g_assert (interest != NULL);
+
+  for (i = 0; i < G_LOG_LEVEL_USER_SHIFT; i++) {
+    if ((levels & (1 << i)) == 0)
+      continue;
+
+    g_assert (interest->counts[i] > 0);
+    if (--interest->counts[i] == 0)
+      interest->levels &= ~(1 << i);
+  }
+
+  g_atomic_int_add (&interests.n_interests, -1);
+
+  G_UNLOCK (interests);
+}
+
+static Repeats* current_repeats (void) {
+  Repeats* repeats = g_private_get (&thread_repeats);
+
+  return repeats != NULL ? repeats : &shared_repeats;
+}
+
+/* must hold the repeats lock */
+static void report_repeats (Repeats* repeats) {
+  if (repeats->n_repeats == 0)
+    return;
+
+  gtu_log_diagnostic ("last message repeated %u time%s",
+                      repeats->n_repeats, repeats->n_repeats == 1 ? "" : "s");
+  repeats->n_repeats = 0;
+}
+
+/* Returns whether a message should be printed, which is decided before it's
+   formatted: a burst of repeats shouldn't cost more than a string compare
+   each. */
+static bool should_print (const char* domain,
+                          GLogLevelFlags level,
+                          const char* message)
+{
+  bool ret;
+  unsigned hash = g_str_hash (message);
+  Repeats* repeats = current_repeats ();
+
+  G_LOCK (repeats);
+
+  if (repeats->body != NULL          &&
+      repeats->body_hash == hash     &&
+      repeats->level == level        &&
+      g_strcmp0 (repeats->domain, domain) == 0 &&
+      strcmp (repeats->body->str, message) == 0)
+  {
+    /* repeats of a message dropped over budget are dropped too */
+    if (repeats->printed)
+      repeats->n_repeats++;
+    else
+      repeats->n_dropped++;
+
+    G_UNLOCK (repeats);
+    return false;
+  }
+
+  report_repeats (repeats);
+
+  if (g_strcmp0 (repeats->domain, domain) != 0) {
+    g_free (repeats->domain);
+    repeats->domain = g_strdup (domain);
+  }
+
+  if (repeats->body == NULL)
+    repeats->body = g_string_new (NULL);
+
+  g_string_assign (repeats->body, message);
+  repeats->body_hash = hash;
+  repeats->level = level;
+
+  ret = line_budget == 0 || repeats->n_printed < line_budget;
+  repeats->printed = ret;
+  if (ret)
+    repeats->n_printed++;
+  else
+    repeats->n_dropped++;
+
+  G_UNLOCK (repeats);
+  return ret;
+}
+
+void gtu_log_g_set_line_budget (unsigned budget) {
+  G_LOCK (repeats);
+  line_budget = budget;
+  G_UNLOCK (repeats);
+}
+
+void gtu_log_g_begin_thread_test (void) {
+  g_return_if_fail (g_private_get (&thread_repeats) == NULL);
+  g_private_set (&thread_repeats, g_slice_new0 (Repeats));
+}
+
+void gtu_log_g_end_test (void) {
+  Repeats* repeats = current_repeats ();
+
+  G_LOCK (repeats);
+
+  report_repeats (repeats);
+
+  if (repeats->n_dropped > 0)
+    gtu_log_diagnostic ("%u further messages dropped; "
+                        "log budget of %u messages per test exceeded",
+                        repeats->n_dropped, line_budget);
+
+  if (repeats != &shared_repeats) {
+    G_UNLOCK (repeats);
+
+    g_private_set (&thread_repeats, NULL);
+
+    g_free (repeats->domain);
+    if (repeats->body != NULL)
+      g_string_free (repeats->body, true);
+    g_slice_free (Repeats, repeats);
+
+    return;
+  }
+
+  /* the first message of the next test shouldn't count as a repeat */
+  if (repeats->body != NULL)
+    g_string_truncate (repeats->body, 0);
+  repeats->body_hash = g_str_hash ("");
+  repeats->level = 0;
+  repeats->printed = false;
+
+  repeats->n_printed = 0;
+  repeats->n_dropped = 0;
+
+  G_UNLOCK (repeats);
+}
+
 static void stdfd_handler (const char* message) {
   gtu_log_diagnostic (message);
 }
@@ -74,16 +324,63 @@ static void message_handler (const char* domain,
 {
   (void) data;
 
-  if (!SHOULD_SUPPRESS (domain, level, message)) {
+  if (should_drop (domain, level))
+    return;
+
+  if (!SHOULD_SUPPRESS (domain, level, message, NULL, 0)) {
     if (level & G_LOG_FLAG_FATAL) {
+      gtu_log_g_end_test ();
       message_bailout (domain, level, message);
-    } else {
+    } else if (should_print (domain, level, message)) {
       message_printer (domain, level, message);
     }
   }
 }
 
 #if STRUCTURED_LOGGING_AVAILABLE
+/* Field keys are compared by their contents, since a key passed in by the
+   caller may live anywhere; strcmp gives up at the first byte for almost all
+   of them. */
+static bool key_is (const char* key, const char* expected) {
+  return strcmp (key, expected) == 0;
+}
+
+static void append_field (GString* string, const GLogField* field) {
+  const char* value;
+  size_t i;
+
+  g_string_append_c (string, '\'');
+  g_string_append (string, field->key);
+  g_string_append (string, "': ");
+
+  if (field->length != -1) {
+    g_string_append_printf (string, "<binary data, %" G_GSSIZE_FORMAT
+                                    " bytes>\n",
+                            field->length);
+    return;
+  }
+
+  value = (const char*) field->value;
+
+  /* most values don't need escaping, in which case we can skip the copy */
+  for (i = 0; value[i] != '\0'; i++) {
+    unsigned char c = value[i];
+
+    if ((c < 0x20 && c != '\t') || c >= 0x7F || c == '\\')
+      break;
+  }
+
+  if (value[i] == '\0') {
+    g_string_append (string, value);
+  } else {
+    char* escaped = g_strescape (value, "\t'\"");
+    g_string_append (string, escaped);
+    g_free (escaped);
+  }
+
+  g_string_append_c (string, '\n');
+}
+
 static GLogWriterOutput structured_handler (GLogLevelFlags level,
                                             const GLogField* fields,
                                             size_t n_fields,
@@ -105,9 +402,9 @@ static GLogWriterOutput structured_handler (GLogLevelFlags level,
   for (i = 0; i < n_fields && (message == NULL || domain == NULL); i++) {
     const char** var;
 
-    if (strcmp (fields[i].key, "MESSAGE") == 0) {
+    if (message == NULL && key_is (fields[i].key, "MESSAGE")) {
       var = &message;
-    } else if (strcmp (fields[i].key, "GLIB_DOMAIN") == 0) {
+    } else if (domain == NULL && key_is (fields[i].key, "GLIB_DOMAIN")) {
       var = &domain;
     } else {
       continue;
@@ -117,14 +414,24 @@ static GLogWriterOutput structured_handler (GLogLevelFlags level,
     *var = (const char*) fields[i].value;
   }
 
-  /* call SHOULD_SUPPRESS before we allocate any memory */
-  if (message != NULL && SHOULD_SUPPRESS (domain, level, message))
+  if (should_drop (domain, level))
+    goto ret;
+
+  /* call SHOULD_SUPPRESS before we allocate any memory; messages without a
+     MESSAGE field go through it too, since expectations can match on the
+     other fields */
+  if (SHOULD_SUPPRESS (domain, level, message, fields, n_fields))
+    goto ret;
+
+  if (level & G_LOG_FLAG_FATAL)
+    gtu_log_g_end_test ();
+  else if (message != NULL && !should_print (domain, level, message))
     goto ret;
 
   formatted_message = g_string_new ("Structured message:");
 
   if (message != NULL) {
-    GtuLogGMessage g_message = { domain, level, message };
+    GtuLogGMessage g_message = { domain, level, message, NULL, 0 };
 
     g_string_append_c (formatted_message, ' ');
     gtu_log_g_format_message_append (formatted_message, &g_message);
@@ -132,20 +439,8 @@ static GLogWriterOutput structured_handler (GLogLevelFlags level,
 
   g_string_append_c (formatted_message, '\n');
 
-  for (i = 0; i < n_fields; i++) {
-    char* value = NULL;
-
-    if (fields[i].length == -1)
-      value = g_strescape ((const char*) fields[i].value, "\t'\"");
-
-    g_string_append_printf (formatted_message,
-                            "'%s': %s\n",
-                            fields[i].key,
-                            value != NULL ? value : "<binary data>");
-
-    if (value != NULL)
-      g_free (value);
-  }
+  for (i = 0; i < n_fields; i++)
+    append_field (formatted_message, &fields[i]);
 
   gtu_log_diagnostic (formatted_message->str);
   g_string_free (formatted_message, true);
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "priv.h"
 #include "logio.h"
 #include "log-hooks.h"
@@ -54,16 +56,35 @@
 */
 
 
-typedef struct _Hook Hook;
+/*
+  Every message from every thread goes through invoke_hooks(), so it takes no
+  locks. The hook stack is an immutable array, top first, which is replaced
+  wholesale whenever a hook is pushed or popped; writers are serialised by the
+  hooks lock.
+
+  A replaced array is freed once no reader can still be looking at it. Readers
+  announce themselves in one of two counters, picked by the parity of `epoch',
+  and only then load `current'. A writer publishes the new array, advances
+  `epoch' and waits for the counter belonging to the old epoch to drain, which
+  can only take as long as the hooks already running.
+*/
 
-struct _Hook {
+typedef struct {
   GtuLogHook  func;
   const void* target;
-  Hook* next;
-};
+} Hook;
+
+typedef struct {
+  unsigned length;
+  Hook     hooks[];
+} HookArray;
 
 G_LOCK_DEFINE_STATIC (hooks);
-static Hook* hooks = NULL;
+static struct {
+  HookArray* volatile current;
+  volatile int        epoch;
+  volatile int        readers[2];
+} hooks = { NULL, 0, { 0, 0 } };
 
 /* we can't just take the address of g_logv() because of the PLT */
 static void (*glogv_address) (const char*, int, const char*, va_list) = NULL;
@@ -72,6 +93,34 @@ static void (*abort_handler_address) (void) = NULL;
 
 static char* _log_domain = NULL;
 
+/* Where g_logv() was found the last time we aborted: how many frames above
+   do_abort() it was and the address it was executing. Messages nearly always
+   arrive by the same route, so next time we step that far and compare the
+   address rather than looking up every procedure on the way. Both are only
+   hints; a torn read just fails the comparison, as would an address that
+   isn't in g_logv(). */
+static struct {
+  volatile unsigned   depth; /* 0 if we haven't been here yet */
+  volatile unw_word_t ip;
+} abort_plan = { 0, 0 };
+
+
+/* leaves `cursor' on g_logv()'s frame if the plan still holds */
+static bool follow_abort_plan (unw_cursor_t* cursor) {
+  unsigned depth = abort_plan.depth;
+  unw_word_t expected_ip = abort_plan.ip;
+  unw_word_t ip;
+  unsigned i;
+
+  if (depth == 0)
+    return false;
+
+  for (i = 0; i < depth; i++)
+    if (unw_step (cursor) <= 0)
+      return false;
+
+  return unw_get_reg (cursor, UNW_REG_IP, &ip) == 0 && ip == expected_ip;
+}
 
 G_GNUC_NORETURN static void do_abort (void) {
   /* we don't want to log on assertion failure */
@@ -85,11 +134,16 @@ G_GNUC_NORETURN static void do_abort (void) {
   assert (unw_getcontext (&unwind_context) == 0);
   assert (unw_init_local (&cursor, &unwind_context) == 0);
 
-  {
+  if (!follow_abort_plan (&cursor)) {
     unw_proc_info_t procedure_info;
+    unw_word_t ip;
+    unsigned depth = 0;
     bool found_glogv = false;
 
+    assert (unw_init_local (&cursor, &unwind_context) == 0);
+
     while ((unw_res = unw_step (&cursor)) > 0) {
+      depth++;
       assert (unw_get_proc_info (&cursor, &procedure_info) == 0);
 
       if (procedure_info.start_ip == (unw_word_t) glogv_address) {
@@ -101,6 +155,10 @@ G_GNUC_NORETURN static void do_abort (void) {
     /* assert that there wasn't an error and we didn't reach the last frame */
     assert (unw_res > 0);
     assert (found_glogv);
+
+    assert (unw_get_reg (&cursor, UNW_REG_IP, &ip) == 0);
+    abort_plan.ip = ip;
+    abort_plan.depth = depth;
   }
 
   glogv_cursor = cursor;
@@ -120,23 +178,91 @@ G_GNUC_NORETURN static void do_abort (void) {
 # undef assert
 }
 
+/* How many reads each thread has in progress in either counter, so a thread
+   jumping out of a hook without coming back through hooks_read_end() (a test
+   crashing in one, say) can give them up with gtu_log_hooks_abandon_reads(). */
+static GPrivate thread_reads = G_PRIVATE_INIT (&g_free);
+
+static int* get_thread_reads (void) {
+  int* reads = g_private_get (&thread_reads);
+
+  if (G_UNLIKELY (reads == NULL)) {
+    reads = g_new0 (int, 2);
+    g_private_set (&thread_reads, reads);
+  }
+
+  return reads;
+}
+
+/* returns the epoch to be passed to hooks_read_end() */
+static int hooks_read_begin (void) {
+  int* reads = get_thread_reads ();
+
+  for (;;) {
+    int epoch = g_atomic_int_get (&hooks.epoch);
+
+    reads[epoch & 1]++;
+    g_atomic_int_inc (&hooks.readers[epoch & 1]);
+
+    /* if a writer moved on in the meantime, it might not wait for us */
+    if (G_LIKELY (g_atomic_int_get (&hooks.epoch) == epoch))
+      return epoch;
+
+    g_atomic_int_add (&hooks.readers[epoch & 1], -1);
+    reads[epoch & 1]--;
+  }
+}
+
+static void hooks_read_end (int epoch) {
+  g_atomic_int_add (&hooks.readers[epoch & 1], -1);
+  get_thread_reads ()[epoch & 1]--;
+}
+
+void gtu_log_hooks_abandon_reads (void) {
+  int* reads = get_thread_reads ();
+  unsigned i;
+
+  for (i = 0; i < 2; i++) {
+    g_atomic_int_add (&hooks.readers[i], -reads[i]);
+    reads[i] = 0;
+  }
+}
+
+/* must be called with the hooks lock held; takes `array', which may be NULL */
+static void hooks_publish (HookArray* array) {
+  HookArray* old = hooks.current;
+  int epoch = hooks.epoch;
+
+  g_atomic_pointer_set (&hooks.current, array);
+  g_atomic_int_set (&hooks.epoch, epoch + 1);
+
+  while (g_atomic_int_get (&hooks.readers[epoch & 1]) != 0)
+    g_thread_yield ();
+
+  g_free (old);
+}
+
 static bool invoke_hooks (GtuLogGMessage* message, void* user_data) {
-  Hook* cursor;
+  const HookArray* array;
+  unsigned i;
+  int epoch;
 
   (void) user_data;
 
-  G_LOCK (hooks);
+  epoch = hooks_read_begin ();
+  array = g_atomic_pointer_get (&hooks.current);
 
-  for (cursor = hooks; cursor != NULL; cursor = cursor->next) {
+  for (i = 0; array != NULL && i < array->length; i++) {
     GtuLogAction action;
 
-    g_assert (cursor->func != NULL);
-    action = cursor->func (message, (void*) cursor->target);
+    g_assert (array->hooks[i].func != NULL);
+    action = array->hooks[i].func (message, (void*) array->hooks[i].target);
 
     if (action == GTU_LOG_ACTION_CONTINUE)
       continue;
 
-    G_UNLOCK (hooks);
+    /* do_abort() never comes back, so we have to be done with `array' */
+    hooks_read_end (epoch);
 
     if (action == GTU_LOG_ACTION_IGNORE)
       return true;
@@ -147,7 +273,8 @@ static bool invoke_hooks (GtuLogGMessage* message, void* user_data) {
       GtuLogGMessage suppress_message = {
         _log_domain,
         G_LOG_LEVEL_INFO,
-        "Suppressed message: "
+        "Suppressed message: ",
+        NULL, 0
       };
 
       gtu_log_g_format_message_append (string, &suppress_message);
@@ -166,7 +293,7 @@ static bool invoke_hooks (GtuLogGMessage* message, void* user_data) {
     g_assert_not_reached ();
   }
 
-  G_UNLOCK (hooks);
+  hooks_read_end (epoch);
   return false;
 }
 
@@ -227,44 +354,54 @@ void gtu_log_hooks_init (bool fatal_warnings,
 }
 
 void gtu_log_hooks_push (GtuLogHook hook, const void* user_data) {
-  Hook* new_hook;
+  const HookArray* old;
+  HookArray* new_array;
+  unsigned length;
 
   g_assert (hook != NULL);
   G_LOCK (hooks);
 
-  new_hook = g_slice_new (Hook);
-  new_hook->func = hook;
-  new_hook->target = user_data;
-  new_hook->next = hooks;
+  old = hooks.current;
+  length = old != NULL ? old->length : 0;
+
+  new_array = g_malloc (sizeof (HookArray) + (length + 1) * sizeof (Hook));
+  new_array->length = length + 1;
+  new_array->hooks[0].func = hook;
+  new_array->hooks[0].target = user_data;
 
-  hooks = new_hook;
+  if (length > 0)
+    memcpy (&new_array->hooks[1], old->hooks, length * sizeof (Hook));
+
+  hooks_publish (new_array);
   G_UNLOCK (hooks);
 }
 
-void gtu_log_hooks_pop (GtuLogHook hook) {
-  Hook *cursor,
-       *cursor_prev = NULL;
+void gtu_log_hooks_pop (GtuLogHook hook, const void* user_data) {
+  const HookArray* old;
+  HookArray* new_array = NULL;
+  unsigned i;
 
-  g_assert (hooks != NULL);
   G_LOCK (hooks);
 
-  for (cursor = hooks;
-       cursor != NULL;
-       cursor_prev = cursor, cursor = cursor->next)
-  {
-    if (cursor->func != hook)
-      continue;
+  old = hooks.current;
+  g_assert (old != NULL);
 
-    if (cursor_prev != NULL)
-      cursor_prev->next = cursor->next;
-    else
-      hooks = cursor->next;
+  for (i = 0; i < old->length; i++)
+    if (old->hooks[i].func == hook && old->hooks[i].target == user_data)
+      break;
 
-    g_slice_free (Hook, cursor);
+  g_assert (i < old->length);
 
-    G_UNLOCK (hooks);
-    return;
+  if (old->length > 1) {
+    new_array = g_malloc (sizeof (HookArray) +
+                          (old->length - 1) * sizeof (Hook));
+    new_array->length = old->length - 1;
+
+    memcpy (new_array->hooks, old->hooks, i * sizeof (Hook));
+    memcpy (&new_array->hooks[i], &old->hooks[i + 1],
+            (old->length - i - 1) * sizeof (Hook));
   }
 
-  g_assert_not_reached ();
+  hooks_publish (new_array);
+  G_UNLOCK (hooks);
 }
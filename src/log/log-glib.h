@@ -5,12 +5,23 @@
 #include <stdint.h>
 #include <glib.h>
 
+/* structured logging arrived in GLib 2.50; before that, messages never have
+   fields */
+#if !GLIB_CHECK_VERSION (2, 50, 0)
+typedef struct _GLogField GLogField;
+#endif
+
 /**
  * GtuLogGMessage:
  * @domain: (allow-none): GLib log domain.
  * @flags:  GLib log level + flags.
- * @body:   A message logged through the GLib logging machinery from @domain
- *          and with @flags.
+ * @body:   (allow-none): A message logged through the GLib logging machinery
+ *          from @domain and with @flags. Only %NULL for structured messages
+ *          without a MESSAGE field.
+ * @fields: (allow-none): all fields of a structured message, including the
+ *          ones @domain and @body came from, or %NULL if the message wasn't
+ *          structured.
+ * @n_fields: length of @fields.
  *
  * Contains all the details of a message logged with g_log() et al.
  */
@@ -18,6 +29,9 @@ typedef struct {
   const char* const domain;
   GLogLevelFlags flags;
   const char* const body;
+
+  const GLogField* const fields;
+  const size_t n_fields;
 } GtuLogGMessage;
 
 /**
@@ -81,6 +95,65 @@ void gtu_log_g_install_suppress_func (GtuLogGSuppressFunc func,
 void gtu_log_g_uninstall_suppress_func (GtuLogGSuppressFunc func);
 
 /**
+ * gtu_log_g_set_droppable_levels:
+ * @levels: log levels nobody will see by default.
+ *
+ * Messages at @levels are discarded as soon as they reach our handlers,
+ * without being formatted or passed to the suppress function, unless their
+ * domain has an interest registered with gtu_log_g_add_interest(). Fatal
+ * messages are never dropped.
+ */
+void gtu_log_g_set_droppable_levels (GLogLevelFlags levels);
+
+/**
+ * gtu_log_g_add_interest:
+ * @domain: log domain.
+ * @levels: log levels in @domain which shouldn't be dropped early.
+ *
+ * Exempts @levels in @domain from gtu_log_g_set_droppable_levels(), so the
+ * suppress function gets to see them. Registrations are counted; each must be
+ * matched with a call to gtu_log_g_remove_interest().
+ */
+void gtu_log_g_add_interest (const char* domain, GLogLevelFlags levels);
+
+/**
+ * gtu_log_g_remove_interest:
+ * @domain: log domain passed to gtu_log_g_add_interest().
+ * @levels: log levels passed to gtu_log_g_add_interest().
+ */
+void gtu_log_g_remove_interest (const char* domain, GLogLevelFlags levels);
+
+/**
+ * gtu_log_g_set_line_budget:
+ * @budget: maximum number of messages printed per test, or 0 for no limit.
+ *
+ * Limits how many messages logged via GLib are printed between calls to
+ * gtu_log_g_end_test(). Messages over the budget are counted and dropped.
+ * Runs of identical messages are collapsed regardless of the budget, and only
+ * count against it once.
+ */
+void gtu_log_g_set_line_budget (unsigned budget);
+
+/**
+ * gtu_log_g_begin_thread_test:
+ *
+ * Gives messages logged from the calling thread their own repeat count and
+ * budget until the next gtu_log_g_end_test() on this thread, for a test
+ * running alongside others. Otherwise all threads share one.
+ */
+void gtu_log_g_begin_thread_test (void);
+
+/**
+ * gtu_log_g_end_test:
+ *
+ * Prints any pending "last message repeated" notice and the number of
+ * messages dropped over budget, then resets the budget for the next test.
+ * Applies to the calling thread's own count if it has one.
+ */
+void gtu_log_g_end_test (void);
+
+/**
+ * gtu_log_g_format_message_append:
  * @string:  #GString to which the formatted message will be appended.
  * @message: message to be formatted.
  *
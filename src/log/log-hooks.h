@@ -101,12 +101,24 @@ void gtu_log_hooks_push (GtuLogHook hook, const void* user_data);
 
 /**
  * gtu_log_hooks_pop:
- * @hook: hook to pop off the hook stack.
+ * @hook:      hook to pop off the hook stack.
+ * @user_data: user-provided data @hook was pushed with.
  *
  * Removes @hook from the hook stack, preventing it from being called upon
- * receiving further messages. It is an error to call this function if @hook
- * does not exist on the stack.
+ * receiving further messages. The same hook may be on the stack more than
+ * once with different @user_data. It is an error to call this function if
+ * @hook does not exist on the stack with @user_data.
  */
-void gtu_log_hooks_pop (GtuLogHook hook);
+void gtu_log_hooks_pop (GtuLogHook hook, const void* user_data);
+
+/**
+ * gtu_log_hooks_abandon_reads:
+ *
+ * Gives up whatever hook dispatches the calling thread is in the middle of, so
+ * that the hook stack can be changed again. Must be called after jumping out
+ * of a hook by some means other than #GTU_LOG_ACTION_ABORT, such as a crash
+ * being caught, and before the thread next logs anything.
+ */
+void gtu_log_hooks_abandon_reads (void);
 
 #endif
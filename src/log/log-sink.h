@@ -0,0 +1,56 @@
+#ifndef __GII_TEST_UTILS_LOG_SINK_H__
+#define __GII_TEST_UTILS_LOG_SINK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <glib.h>
+
+/**
+ * A file the test log can be diverted to, optionally compressed. Writes are
+ * batched and handed off to a background thread for compression, so a chatty
+ * test costs little more than a memcpy per line.
+ */
+
+/**
+ * gtu_log_sink_open:
+ * @filename: path of the file to be (over)written.
+ * @error:    return location for a #GFileError, or %NULL.
+ *
+ * Starts diverting output passed to gtu_log_sink_write() to @filename. The
+ * compression format is chosen by extension: ".gz" for gzip and, if support
+ * was found at configure time, ".zst" for zstd. Anything else is written as
+ * is. The file is finished off by gtu_log_sink_close(), which is registered to
+ * run at exit.
+ *
+ * Returns: %true if the sink was opened.
+ */
+bool gtu_log_sink_open (const char* filename, GError** error);
+
+/**
+ * gtu_log_sink_write:
+ * @data:   bytes to be logged.
+ * @length: length of @data.
+ *
+ * Queues @data to be written to the sink. May block if the background thread
+ * has fallen too far behind.
+ *
+ * Returns: %false if no sink is open, in which case nothing was written.
+ */
+bool gtu_log_sink_write (const char* data, size_t length);
+
+/**
+ * gtu_log_sink_is_open:
+ *
+ * Returns: whether output is currently being diverted to a sink.
+ */
+bool gtu_log_sink_is_open (void);
+
+/**
+ * gtu_log_sink_close:
+ *
+ * Writes out anything still queued, finishes the compressed stream and closes
+ * the file. Does nothing if no sink is open.
+ */
+void gtu_log_sink_close (void);
+
+#endif
@@ -2,6 +2,7 @@
 #define __GII_TEST_UTILS_LOGIO_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <glib.h>
 
 /**
@@ -9,6 +10,85 @@
  * safe in here, since there's a fair bit of global state.
  */
 
+/**
+ * GtuLogTestDetails:
+ * @duration_us:      wall-clock time spent running the test.
+ * @user_cpu_us:      user CPU time spent running the test.
+ * @sys_cpu_us:       system CPU time spent running the test.
+ * @max_rss_delta_kb: growth of the process' peak resident set size.
+ * @concurrent:       whether other tests were running at the same time, as
+ *                    decided by gtu_log_test_details_begin(). The CPU times
+ *                    then only cover the thread running the test, or are left
+ *                    out where that can't be measured, and @max_rss_delta_kb
+ *                    is left out.
+ * @file:             (allow-none): source file in which the test stopped.
+ * @line:             (allow-none): line of @file, as a string.
+ * @function:         (allow-none): function in which the test stopped.
+ *
+ * Extra information about a test result, written to the log as a YAML block
+ * when gtu_log_enable_yaml() has been called. The location fields must point
+ * to static strings (i.e. #__FILE__, #G_STRFUNC and friends).
+ */
+typedef struct {
+  int64_t duration_us;
+  int64_t user_cpu_us;
+  int64_t sys_cpu_us;
+  long    max_rss_delta_kb;
+  bool    concurrent;
+
+  const char* file;
+  const char* line;
+  const char* function;
+} GtuLogTestDetails;
+
+/**
+ * gtu_log_open_file:
+ * @filename: path of the log file, optionally ending in ".gz" or ".zst".
+ * @summary:  whether the test plan and results should still go to stdout.
+ * @error:    return location for a #GFileError, or %NULL.
+ *
+ * Diverts the log to @filename, compressed according to its extension (see
+ * gtu_log_sink_open()). Must be called before anything else is logged.
+ *
+ * Returns: %true if the file was opened.
+ */
+bool gtu_log_open_file (const char* filename, bool summary, GError** error);
+
+/**
+ * gtu_log_enable_yaml:
+ *
+ * Switches the log to TAP version 13, following every test result with a YAML
+ * diagnostic block built from the #GtuLogTestDetails passed alongside it. This
+ * writes the version line immediately, so it must be called before anything
+ * else is written to the log.
+ */
+void gtu_log_enable_yaml (void);
+
+/**
+ * gtu_log_yaml_enabled:
+ *
+ * Returns: %TRUE if gtu_log_enable_yaml() has been called.
+ */
+bool gtu_log_yaml_enabled (void);
+
+/**
+ * gtu_log_test_details_begin:
+ * @details: details to be filled in.
+ *
+ * Resets @details and takes a snapshot of the clock and resource counters. Does
+ * nothing unless gtu_log_yaml_enabled() is %TRUE.
+ */
+void gtu_log_test_details_begin (GtuLogTestDetails* details);
+
+/**
+ * gtu_log_test_details_end:
+ * @details: details previously passed to gtu_log_test_details_begin().
+ *
+ * Turns the snapshot taken by gtu_log_test_details_begin() into the amount of
+ * time and resources used since.
+ */
+void gtu_log_test_details_end (GtuLogTestDetails* details);
+
 /**
  * gtu_log_test_plan:
  * @n_tests: number of tests expected to run.
@@ -36,6 +116,93 @@ void gtu_log_disable_test_plan (void);
  */
 void gtu_log_diagnostic (const char* format, ...);
 
+/**
+ * gtu_log_capture_enable:
+ * @limit: number of bytes to hold in memory before spilling to a temporary
+ *         file.
+ *
+ * Makes gtu_log_capture_begin() effective. Only the first call has any
+ * effect.
+ */
+void gtu_log_capture_enable (size_t limit);
+
+/**
+ * gtu_log_capture_begin:
+ *
+ * If capturing has been enabled with gtu_log_capture_enable(), diagnostics
+ * are held back from the log from here on until gtu_log_capture_end() is
+ * called. Test results and bail outs are never held back; the latter replays
+ * anything captured before bailing out.
+ */
+void gtu_log_capture_begin (void);
+
+/**
+ * gtu_log_capture_end:
+ * @replay: %TRUE to write the captured diagnostics to the log, %FALSE to
+ *          discard them.
+ *
+ * Stops capturing diagnostics started by gtu_log_capture_begin().
+ */
+void gtu_log_capture_end (bool replay);
+
+/**
+ * GtuLogCapture:
+ *
+ * Diagnostics held back for a test running alongside others.
+ */
+typedef struct _GtuLogCapture GtuLogCapture;
+
+/**
+ * gtu_log_capture_new:
+ *
+ * Returns: (transfer full): a new, empty #GtuLogCapture, to be passed to
+ *          gtu_log_capture_finish() once its test has finished.
+ */
+GtuLogCapture* gtu_log_capture_new (void);
+
+/**
+ * gtu_log_capture_set_thread:
+ * @capture: (allow-none): where diagnostics from the calling thread should
+ *           go, or %NULL to write them to the log as usual.
+ *
+ * Diverts diagnostics written from the calling thread into @capture,
+ * regardless of gtu_log_capture_enable(). This takes precedence over
+ * gtu_log_capture_begin().
+ */
+void gtu_log_capture_set_thread (GtuLogCapture* capture);
+
+/**
+ * gtu_log_capture_get_thread:
+ *
+ * Returns: (transfer none): the #GtuLogCapture set for the calling thread, or
+ *          %NULL.
+ */
+GtuLogCapture* gtu_log_capture_get_thread (void);
+
+/**
+ * gtu_log_capture_finish:
+ * @capture: (transfer full): a #GtuLogCapture no thread is using any more.
+ * @failed:  whether the test @capture belongs to failed.
+ *
+ * Writes the diagnostics held in @capture to the log and frees it. If
+ * capturing was enabled with gtu_log_capture_enable(), they are only written
+ * if @failed, as with gtu_log_capture_end(). If gtu_log_capture_bail_out()
+ * was called on @capture, this then bails out and doesn't return.
+ */
+void gtu_log_capture_finish (GtuLogCapture* capture, bool failed);
+
+/**
+ * gtu_log_capture_bail_out:
+ * @capture: the #GtuLogCapture of a test running alongside others.
+ * @message: why the run has to stop.
+ *
+ * Has gtu_log_capture_finish() bail out with @message once it has written out
+ * @capture, rather than bailing out straight away from a thread whose results
+ * are reported later; everything reported before @capture's test then stays
+ * in order. Only the first message is kept.
+ */
+void gtu_log_capture_bail_out (GtuLogCapture* capture, const char* message);
+
 /**
  * gtu_log_bail_out:
  * @should_trap: %TRUE if we should abort, %FALSE to call exit()
@@ -53,33 +220,43 @@ void gtu_log_bail_out (bool should_trap, const char* format, ...)
  * gtu_log_test_success:
  * @text_description: (allow-none): description of the test.
  * @directive:        (allow-none): additional information about the success.
+ * @details:          (allow-none): timing and resource usage of the test.
  *
  * Indicate to the test harness that a test has passed successfully.
  *
  * Neither @test_description nor @directive shall contain newline characters.
  */
-void gtu_log_test_success (const char* test_description, const char* directive);
+void gtu_log_test_success (const char* test_description,
+                           const char* directive,
+                           const GtuLogTestDetails* details);
 
 /**
  * gtu_log_test_skipped:
  * @text_description: (allow-none): description of the test.
  * @directive:        (allow-none): additional information about the skip.
+ * @details:          (allow-none): timing and resource usage of the test.
  *
  * Indicate to the test harness that a test was skipped.
  *
  * Neither @test_description nor @directive shall contain newline characters.
  */
-void gtu_log_test_skipped (const char* test_description, const char* directive);
+void gtu_log_test_skipped (const char* test_description,
+                           const char* directive,
+                           const GtuLogTestDetails* details);
 
 /**
  * gtu_log_test_failed:
  * @text_description: (allow-none): description of the test.
  * @directive:        (allow-none): additional information about the skip.
+ * @details:          (allow-none): timing, resource usage and location of the
+ *                    failure.
  *
  * Indicate to the test harness that a test has failed.
  *
  * Neither @test_description nor @directive shall contain newline characters.
  */
-void gtu_log_test_failed (const char* test_description, const char* directive);
+void gtu_log_test_failed (const char* test_description,
+                          const char* directive,
+                          const GtuLogTestDetails* details);
 
 #endif
@@ -0,0 +1,306 @@
+/* Implementation of log-sink.h */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include "priv.h"
+#include "log-sink.h"
+
+/* Output is collected into chunks of roughly CHUNK_SIZE bytes, which are
+   passed to the writer thread through the `full' queue and come back through
+   `empty' once written. There are only N_CHUNKS of them, so if compression
+   can't keep up we end up waiting on `empty' instead of buffering without
+   bound. */
+#define CHUNK_SIZE (64 * 1024)
+#define N_CHUNKS   (8)
+
+/* GAsyncQueue doesn't take NULL, so anything else that can't be a chunk will
+   do to tell the writer thread to finish up */
+#define END_OF_STREAM ((void*) &sink)
+
+typedef enum {
+  CODEC_NONE,
+  CODEC_GZIP,
+  CODEC_ZSTD
+} Codec;
+
+/* Everything from `codec' to `failed' belongs to the writer thread once it's
+   started; the rest is protected by the sink lock. */
+G_LOCK_DEFINE_STATIC (sink);
+static struct {
+  Codec      codec;
+  FILE*      file;
+  z_stream   zlib;
+#ifdef HAVE_ZSTD
+  ZSTD_CCtx* zstd;
+#endif
+  bool       failed;
+
+  GThread*     thread;
+  GAsyncQueue* full;
+  GAsyncQueue* empty;
+  GString*     current;
+} sink;
+
+static void file_write (const void* data, size_t length) {
+  if (sink.failed || length == 0)
+    return;
+
+  if (fwrite (data, 1, length, sink.file) != length) {
+    fprintf (stderr, "Error: failed to write log file: %s\n",
+             g_strerror (errno));
+    sink.failed = true;
+  }
+}
+
+static void gzip_encode (const char* data, size_t length, bool finish) {
+  unsigned char out[CHUNK_SIZE];
+  int status;
+
+  sink.zlib.next_in = (Bytef*) data;
+  sink.zlib.avail_in = (uInt) length;
+
+  for (;;) {
+    sink.zlib.next_out = out;
+    sink.zlib.avail_out = sizeof (out);
+
+    status = deflate (&sink.zlib, finish ? Z_FINISH : Z_NO_FLUSH);
+    if (status == Z_STREAM_ERROR) {
+      fprintf (stderr, "Error: failed to compress log file\n");
+      sink.failed = true;
+      return;
+    }
+
+    file_write (out, sizeof (out) - sink.zlib.avail_out);
+
+    /* deflate() only stops short of filling `out' once it has consumed all
+       of the input, but finishing can take a few more rounds */
+    if (finish ? status == Z_STREAM_END : sink.zlib.avail_out != 0)
+      break;
+  }
+
+  if (finish)
+    deflateEnd (&sink.zlib);
+}
+
+#ifdef HAVE_ZSTD
+static void zstd_encode (const char* data, size_t length, bool finish) {
+  unsigned char out[CHUNK_SIZE];
+  ZSTD_inBuffer in = { data, length, 0 };
+  size_t remaining;
+
+  do {
+    ZSTD_outBuffer output = { out, sizeof (out), 0 };
+
+    remaining = ZSTD_compressStream2 (sink.zstd, &output, &in,
+                                      finish ? ZSTD_e_end : ZSTD_e_continue);
+    if (ZSTD_isError (remaining)) {
+      fprintf (stderr, "Error: failed to compress log file: %s\n",
+               ZSTD_getErrorName (remaining));
+      sink.failed = true;
+      return;
+    }
+
+    file_write (out, output.pos);
+  } while (finish ? remaining != 0 : in.pos < in.size);
+
+  if (finish)
+    ZSTD_freeCCtx (sink.zstd);
+}
+#endif
+
+static void encode (const char* data, size_t length, bool finish) {
+  switch (sink.codec) {
+    case CODEC_NONE:
+      file_write (data, length);
+      break;
+
+    case CODEC_GZIP:
+      gzip_encode (data, length, finish);
+      break;
+
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+      zstd_encode (data, length, finish);
+      break;
+#endif
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+static void* writer_thread (void* data) {
+  GString* chunk;
+
+  (void) data;
+
+  while ((chunk = g_async_queue_pop (sink.full)) != END_OF_STREAM) {
+    encode (chunk->str, chunk->len, false);
+
+    g_string_truncate (chunk, 0);
+    g_async_queue_push (sink.empty, chunk);
+  }
+
+  encode (NULL, 0, true);
+
+  return NULL;
+}
+
+static bool codec_init (const char* filename, GError** error) {
+  if (g_str_has_suffix (filename, ".gz")) {
+    sink.codec = CODEC_GZIP;
+
+    /* adding 16 to the window bits gets us a gzip header */
+    if (deflateInit2 (&sink.zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                      15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                   "failed to initialise zlib");
+      return false;
+    }
+
+  } else if (g_str_has_suffix (filename, ".zst")) {
+#ifdef HAVE_ZSTD
+    sink.codec = CODEC_ZSTD;
+    sink.zstd = ZSTD_createCCtx ();
+
+    if (sink.zstd == NULL) {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                   "failed to initialise zstd");
+      return false;
+    }
+#else
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+                 "built without zstd support");
+    return false;
+#endif
+
+  } else {
+    sink.codec = CODEC_NONE;
+  }
+
+  return true;
+}
+
+static void codec_free (void) {
+  switch (sink.codec) {
+    case CODEC_GZIP:
+      deflateEnd (&sink.zlib);
+      break;
+
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+      ZSTD_freeCCtx (sink.zstd);
+      break;
+#endif
+
+    default:
+      break;
+  }
+}
+
+bool gtu_log_sink_open (const char* filename, GError** error) {
+  int i;
+
+  g_return_val_if_fail (filename != NULL, false);
+  g_return_val_if_fail (error == NULL || *error == NULL, false);
+  g_return_val_if_fail (!gtu_log_sink_is_open (), false);
+
+  if (!codec_init (filename, error))
+    return false;
+
+  sink.file = fopen (filename, "wb");
+  if (sink.file == NULL) {
+    int saved_errno = errno;
+
+    codec_free ();
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                 "%s", g_strerror (saved_errno));
+    return false;
+  }
+
+  G_LOCK (sink);
+
+  sink.full = g_async_queue_new ();
+  sink.empty = g_async_queue_new ();
+
+  for (i = 0; i < N_CHUNKS - 1; i++)
+    g_async_queue_push (sink.empty, g_string_sized_new (CHUNK_SIZE));
+
+  sink.current = g_string_sized_new (CHUNK_SIZE);
+  sink.thread = g_thread_new ("gtu-log-sink", &writer_thread, NULL);
+
+  G_UNLOCK (sink);
+
+  atexit (&gtu_log_sink_close);
+
+  return true;
+}
+
+bool gtu_log_sink_write (const char* data, size_t length) {
+  G_LOCK (sink);
+
+  if (sink.thread == NULL) {
+    G_UNLOCK (sink);
+    return false;
+  }
+
+  g_string_append_len (sink.current, data, (gssize) length);
+
+  if (sink.current->len >= CHUNK_SIZE) {
+    g_async_queue_push (sink.full, sink.current);
+    sink.current = g_async_queue_pop (sink.empty);
+  }
+
+  G_UNLOCK (sink);
+  return true;
+}
+
+bool gtu_log_sink_is_open (void) {
+  bool ret;
+
+  G_LOCK (sink);
+  ret = sink.thread != NULL;
+  G_UNLOCK (sink);
+
+  return ret;
+}
+
+void gtu_log_sink_close (void) {
+  GString* chunk;
+
+  G_LOCK (sink);
+
+  if (sink.thread == NULL) {
+    G_UNLOCK (sink);
+    return;
+  }
+
+  g_async_queue_push (sink.full, sink.current);
+  g_async_queue_push (sink.full, END_OF_STREAM);
+  g_thread_join (sink.thread);
+
+  while ((chunk = g_async_queue_try_pop (sink.empty)) != NULL)
+    g_string_free (chunk, true);
+
+  g_async_queue_unref (sink.full);
+  g_async_queue_unref (sink.empty);
+
+  if (fclose (sink.file) != 0 && !sink.failed)
+    fprintf (stderr, "Error: failed to write log file: %s\n",
+             g_strerror (errno));
+
+  sink.thread = NULL;
+  sink.current = NULL;
+  sink.file = NULL;
+
+  G_UNLOCK (sink);
+}
@@ -1,26 +1,74 @@
 /* Implementation of logio.h */
 
+#define _GNU_SOURCE /* for RUSAGE_THREAD */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 
 #include "priv.h"
 #include "logio.h"
 #include "log-color.h"
+#include "log-sink.h"
 
 static volatile unsigned test_count = 0;
 static unsigned expected_tests = 0;
+static bool yaml_enabled = false;
 G_LOCK_DEFINE_STATIC (stdout);
 
+/* whether summary lines still go to stdout whilst there's a log file open.
+   Protected by the stdout lock. */
+static bool stdout_summary = false;
+
+/* Diagnostics written whilst a capture is active are held back until the test
+   result is known. They go into `buffer' until it would grow past the limit,
+   at which point everything is moved into an anonymous temporary file.
+   `bail_out' is why the run has to stop once they've been written out.
+   Protected by the stdout lock. */
+struct _GtuLogCapture {
+  GString* buffer;
+  FILE*    spill;
+  char*    bail_out;
+};
+
+/* `held' is used by gtu_log_capture_begin(), which is for tests run one at a
+   time */
+static struct {
+  bool          enabled;
+  bool          active;
+  size_t        limit;
+  GtuLogCapture held;
+} capture = { false, false, 0, { NULL, NULL, NULL } };
+
+/* Tests running alongside others always have their diagnostics held back, so
+   they can be written out in order. That takes a limit of its own when
+   --capture-log wasn't given. */
+#define THREAD_CAPTURE_LIMIT (1 << 20)
+
+static GPrivate thread_capture = G_PRIVATE_INIT (NULL);
+
 static const char* diagnostic (void) {
   return gtu_log_supports_color () ?
     "\033[1m#\033[0m " : /* bolded '# ' */
     "# ";
 }
 
+/* Must hold the stdout lock. The test plan, results and bail outs count as
+   `summary'; diagnostics don't. */
+static void output_write (const char* data, size_t length, bool summary) {
+  if (!gtu_log_sink_write (data, length) || (summary && stdout_summary))
+    fwrite (data, 1, length, stdout);
+}
+
 static void log_vprintf (const char* format, va_list args) {
+  char* line = g_strdup_vprintf (format, args);
+
   G_LOCK (stdout);
-  vfprintf (stdout, format, args);
+  output_write (line, strlen (line), true);
   G_UNLOCK (stdout);
+
+  g_free (line);
 }
 
 static void log_printf (const char* format, ...) {
@@ -29,29 +77,89 @@ static void log_printf (const char* format, ...) {
   log_vprintf (format, args);
 }
 
+/* must hold the stdout lock */
+static void capture_write (GtuLogCapture* target,
+                           const char* data,
+                           size_t length)
+{
+  size_t limit = capture.enabled ? capture.limit : THREAD_CAPTURE_LIMIT;
+
+  if (target->spill == NULL && target->buffer->len + length > limit) {
+    target->spill = tmpfile ();
+
+    /* if we can't get a file, we'd rather use more memory than lose logs */
+    if (target->spill != NULL) {
+      fwrite (target->buffer->str, 1, target->buffer->len, target->spill);
+      g_string_truncate (target->buffer, 0);
+    }
+  }
+
+  if (target->spill != NULL)
+    fwrite (data, 1, length, target->spill);
+  else
+    g_string_append_len (target->buffer, data, (gssize) length);
+}
+
+/* must hold the stdout lock */
+static void capture_flush (GtuLogCapture* target, bool replay) {
+  if (target->spill != NULL) {
+    if (replay) {
+      char chunk[BUFSIZ];
+      size_t length;
+
+      rewind (target->spill);
+      while ((length = fread (chunk, 1, sizeof (chunk), target->spill)) > 0)
+        output_write (chunk, length, false);
+    }
+
+    fclose (target->spill);
+    target->spill = NULL;
+  }
+
+  if (replay)
+    output_write (target->buffer->str, target->buffer->len, false);
+
+  g_string_truncate (target->buffer, 0);
+}
+
 static void diag_vprintf (const char* format, va_list args) {
   int i;
   char buf;
+  GString* diag;
 
   char* message = g_strdup_vprintf (format, args);
-
-  G_LOCK (stdout);
+  GtuLogCapture* target = g_private_get (&thread_capture);
 
   /* To be TAP-compliant, lines written to stdout that aren't test results must
-     be prefixed with '#'. We iterate through `message', printing "# " after
+     be prefixed with '#'. We iterate through `message', adding "# " after
      every newline unless it's a trailing newline. */
-  fprintf (stdout, diagnostic ());
-  for (i = 0, buf = '\0'; message[i] != '\0'; fputc (buf, stdout), i++) {
-    if (buf == '\n')
-      fprintf (stdout, "%s  ", diagnostic ()); /* add some indenting */
+  diag = g_string_new (diagnostic ());
+  for (i = 0, buf = '\0'; message[i] != '\0'; i++) {
+    if (buf == '\n') {
+      g_string_append (diag, diagnostic ());
+      g_string_append (diag, "  "); /* add some indenting */
+    }
+
     buf = message[i];
+    g_string_append_c (diag, buf);
   }
 
   if (buf != '\n')
-    fputc ('\n', stdout);
+    g_string_append_c (diag, '\n');
+
+  G_LOCK (stdout);
+
+  if (target == NULL && capture.active)
+    target = &capture.held;
+
+  if (target != NULL)
+    capture_write (target, diag->str, diag->len);
+  else
+    output_write (diag->str, diag->len, false);
 
   G_UNLOCK (stdout);
 
+  g_string_free (diag, true);
   g_free (message);
 }
 
@@ -97,62 +205,321 @@ void gtu_log_diagnostic (const char* format, ...) {
   diag_vprintf (format, args);
 }
 
+void gtu_log_capture_enable (size_t limit) {
+  G_LOCK (stdout);
+
+  if (!capture.enabled) {
+    capture.enabled = true;
+    capture.limit = limit;
+    capture.held.buffer = g_string_new (NULL);
+  }
+
+  G_UNLOCK (stdout);
+}
+
+void gtu_log_capture_begin (void) {
+  G_LOCK (stdout);
+  capture.active = capture.enabled;
+  G_UNLOCK (stdout);
+}
+
+void gtu_log_capture_end (bool replay) {
+  G_LOCK (stdout);
+
+  if (capture.active) {
+    capture_flush (&capture.held, replay);
+    capture.active = false;
+  }
+
+  G_UNLOCK (stdout);
+}
+
+GtuLogCapture* gtu_log_capture_new (void) {
+  GtuLogCapture* ret = g_slice_new (GtuLogCapture);
+
+  ret->buffer = g_string_new (NULL);
+  ret->spill = NULL;
+  ret->bail_out = NULL;
+
+  return ret;
+}
+
+void gtu_log_capture_set_thread (GtuLogCapture* target) {
+  g_private_set (&thread_capture, target);
+}
+
+GtuLogCapture* gtu_log_capture_get_thread (void) {
+  return g_private_get (&thread_capture);
+}
+
+void gtu_log_capture_bail_out (GtuLogCapture* target, const char* message) {
+  g_return_if_fail (target != NULL && message != NULL);
+
+  G_LOCK (stdout);
+
+  /* the first failure is the one that would have stopped the run */
+  if (target->bail_out == NULL)
+    target->bail_out = g_strdup (message);
+
+  G_UNLOCK (stdout);
+}
+
+void gtu_log_capture_finish (GtuLogCapture* target, bool failed) {
+  char* bail_out;
+
+  g_return_if_fail (target != NULL);
+
+  G_LOCK (stdout);
+
+  /* with --capture-log, only failures are worth reading */
+  capture_flush (target, failed || target->bail_out != NULL ||
+                         !capture.enabled);
+  bail_out = target->bail_out;
+
+  G_UNLOCK (stdout);
+
+  g_string_free (target->buffer, true);
+  g_slice_free (GtuLogCapture, target);
+
+  if (bail_out != NULL) {
+    gtu_log_bail_out (false, "%s", bail_out);
+    g_assert_not_reached ();
+  }
+}
+
 void gtu_log_bail_out (bool should_trap, const char* format, ...) {
   va_list args;
+  GString* line;
 
   /* pre-empt the atexit() handler */
   gtu_log_disable_test_plan ();
 
   G_LOCK (stdout);
 
-  fprintf (stdout, "Bail out!");
+  /* whatever was captured is probably the best clue as to why we're here */
+  if (g_private_get (&thread_capture) != NULL)
+    capture_flush (g_private_get (&thread_capture), true);
+
+  if (capture.active) {
+    capture_flush (&capture.held, true);
+    capture.active = false;
+  }
+
+  line = g_string_new ("Bail out!");
 
   if (format != NULL) {
-    fputc (' ', stdout);
+    g_string_append_c (line, ' ');
     va_start (args, format);
-    vfprintf (stdout, format, args);
+    g_string_append_vprintf (line, format, args);
   }
 
-  fputc ('\n', stdout);
+  g_string_append_c (line, '\n');
+  output_write (line->str, line->len, true);
 
-  if (should_trap)
+  if (should_trap) {
+    /* atexit() handlers won't get a chance to finish the log file */
+    gtu_log_sink_close ();
     g_abort ();
+  }
 
   /* exit status to signal an error to the automake harness */
   exit (99);
 }
 
+bool gtu_log_open_file (const char* filename, bool summary, GError** error) {
+  if (!gtu_log_sink_open (filename, error))
+    return false;
+
+  G_LOCK (stdout);
+  stdout_summary = summary;
+  G_UNLOCK (stdout);
+
+  return true;
+}
+
+void gtu_log_enable_yaml (void) {
+  if (yaml_enabled)
+    return;
+
+  yaml_enabled = true;
+  log_printf ("TAP version 13\n");
+}
+
+bool gtu_log_yaml_enabled (void) {
+  return yaml_enabled;
+}
+
+#ifdef RUSAGE_THREAD
+# define HAVE_THREAD_CPU_TIME true
+#else
+# define HAVE_THREAD_CPU_TIME false
+# define RUSAGE_THREAD RUSAGE_SELF /* never used */
+#endif
+
+static int64_t timeval_to_us (const struct timeval* tv) {
+  return (int64_t) tv->tv_sec * G_USEC_PER_SEC + tv->tv_usec;
+}
+
+/* begin() stores the negated counters and end() adds the current ones, leaving
+   the difference behind. Tests running alongside others only get their own
+   thread's CPU time; the process' would include everybody else's. */
+static void details_accumulate (GtuLogTestDetails* details, int sign) {
+  struct rusage usage;
+  int who = RUSAGE_SELF;
+
+  details->duration_us += sign * g_get_monotonic_time ();
+
+  if (details->concurrent) {
+    if (!HAVE_THREAD_CPU_TIME)
+      return;
+
+    who = RUSAGE_THREAD;
+  }
+
+  if (getrusage (who, &usage) != 0)
+    return;
+
+  details->user_cpu_us += sign * timeval_to_us (&usage.ru_utime);
+  details->sys_cpu_us += sign * timeval_to_us (&usage.ru_stime);
+
+  if (!details->concurrent)
+    details->max_rss_delta_kb += sign * usage.ru_maxrss;
+}
+
+void gtu_log_test_details_begin (GtuLogTestDetails* details) {
+  g_return_if_fail (details != NULL);
+
+  memset (details, 0, sizeof (GtuLogTestDetails));
+
+  /* only tests running alongside others log into a capture of their own */
+  details->concurrent = gtu_log_capture_get_thread () != NULL;
+
+  if (yaml_enabled)
+    details_accumulate (details, -1);
+}
+
+void gtu_log_test_details_end (GtuLogTestDetails* details) {
+  g_return_if_fail (details != NULL);
+
+  if (yaml_enabled)
+    details_accumulate (details, +1);
+}
+
+/* double-quoted YAML scalar; we only need to worry about quotes, backslashes
+   and control characters */
+static void yaml_append_string (GString* string, const char* value) {
+  int i;
+
+  g_string_append_c (string, '"');
+
+  for (i = 0; value[i] != '\0'; i++) {
+    unsigned char c = value[i];
+
+    if (c == '"' || c == '\\')
+      g_string_append_printf (string, "\\%c", c);
+    else if (c < 0x20 || c == 0x7F)
+      g_string_append_printf (string, "\\x%02X", c);
+    else
+      g_string_append_c (string, c);
+  }
+
+  g_string_append_c (string, '"');
+}
+
+static void yaml_append_details (GString* string,
+                                 const GtuLogTestDetails* details)
+{
+  g_string_append (string, "  ---\n");
+
+  g_string_append_printf (string, "  duration_ms: %.3f\n",
+                          details->duration_us / 1000.0);
+
+  if (!details->concurrent || HAVE_THREAD_CPU_TIME) {
+    g_string_append_printf (string, "  user_cpu_ms: %.3f\n",
+                            details->user_cpu_us / 1000.0);
+    g_string_append_printf (string, "  sys_cpu_ms: %.3f\n",
+                            details->sys_cpu_us / 1000.0);
+  }
+
+  /* peak memory use is only the process' */
+  if (!details->concurrent)
+    g_string_append_printf (string, "  max_rss_delta_kb: %ld\n",
+                            details->max_rss_delta_kb);
+
+  if (details->file != NULL) {
+    g_string_append (string, "  at:\n    file: ");
+    yaml_append_string (string, details->file);
+
+    if (details->line != NULL)
+      g_string_append_printf (string, "\n    line: %s", details->line);
+
+    if (details->function != NULL) {
+      g_string_append (string, "\n    function: ");
+      yaml_append_string (string, details->function);
+    }
+
+    g_string_append_c (string, '\n');
+  }
+
+  g_string_append (string, "  ...\n");
+}
+
 static void log_test_result (bool success,
                              const char* test_description,
                              const char* tap_directive,
-                             const char* user_directive)
+                             const char* user_directive,
+                             const GtuLogTestDetails* details)
 {
+  GString* result;
+  size_t result_length;
   bool has_directive = tap_directive != NULL || user_directive != NULL;
   unsigned prev_test_count = g_atomic_int_add (&test_count, 1);
-  log_printf ("%sok %u %s%s%s%s%s\n",
-              success ? "" : "not ",
-              prev_test_count + 1,
-              test_description != NULL ? test_description : "-",
-              has_directive ? " # " : "",
-              tap_directive != NULL ? tap_directive : "",
-              tap_directive != NULL && user_directive != NULL ? " " : "",
-              user_directive != NULL ? user_directive : "");
+
+  result = g_string_new (NULL);
+  g_string_append_printf (result,
+                          "%sok %u %s%s%s%s%s\n",
+                          success ? "" : "not ",
+                          prev_test_count + 1,
+                          test_description != NULL ? test_description : "-",
+                          has_directive ? " # " : "",
+                          tap_directive != NULL ? tap_directive : "",
+                          tap_directive != NULL && user_directive != NULL ?
+                            " " : "",
+                          user_directive != NULL ? user_directive : "");
+
+  result_length = result->len;
+
+  /* the YAML block has to directly follow its result line, so both are
+     written under the one lock */
+  if (yaml_enabled && details != NULL)
+    yaml_append_details (result, details);
+
+  G_LOCK (stdout);
+  output_write (result->str, result_length, true);
+  output_write (result->str + result_length, result->len - result_length,
+                false);
+  G_UNLOCK (stdout);
+
+  g_string_free (result, true);
 }
 
 void gtu_log_test_success (const char* test_description,
-                           const char* directive)
+                           const char* directive,
+                           const GtuLogTestDetails* details)
 {
-  log_test_result (true, test_description, NULL, directive);
+  log_test_result (true, test_description, NULL, directive, details);
 }
 
 void gtu_log_test_skipped (const char* test_description,
-                           const char* directive)
+                           const char* directive,
+                           const GtuLogTestDetails* details)
 {
-  log_test_result (true, test_description, "SKIP", directive);
+  log_test_result (true, test_description, "SKIP", directive, details);
 }
 
 void gtu_log_test_failed (const char* test_description,
-                          const char* directive)
+                          const char* directive,
+                          const GtuLogTestDetails* details)
 {
-  log_test_result (false, test_description, NULL, directive);
+  log_test_result (false, test_description, NULL, directive, details);
 }
@@ -2,14 +2,17 @@
 #include "gtu-priv.h"
 #include <gobject/gvaluecollector.h>
 
+/* There's one of these in every test, so it's kept to 32 bytes. Whether the
+   finalizers chained up is checked by the name having been cleared, rather
+   than with a flag of its own. */
 typedef struct {
-  char*         name;
   GtuTestSuite* parent;
   GtuPath*      path;
+  GQuark        name;
+  int           path_generation; /* see tree_generation */
 
   volatile int ref_count;
   volatile int is_floating;
-  bool has_finalized;       /* sanity checking */
 } GtuTestObjectPrivate;
 
 static int GtuTestObject_private_offset;
@@ -29,6 +32,12 @@ enum {
 
 static unsigned long object_signals[LAST_SIGNAL] = {0};
 
+/* Bumped whenever a suite is given a parent. A cached path checked in an
+   earlier generation is only kept if it still extends its parent's current
+   path, so attaching a subtree costs nothing up front, and each path below
+   it is fixed up the next time it's asked for. */
+static volatile int tree_generation = 0;
+
 static void _gtu_test_object_class_init (void* klass, void* data);
 static void _gtu_test_object_init       (GTypeInstance* self, void* klass);
 static void _gtu_test_object_finalize   (GtuTestObject* self);
@@ -186,7 +195,7 @@ void gtu_test_object_unref (void* instance) {
 
   if (g_atomic_int_dec_and_test (&priv->ref_count)) {
     GTU_TEST_OBJECT_GET_CLASS (self)->finalize (self);
-    g_assert (priv->has_finalized);
+    g_assert (priv->name == 0); /* sanity checking */
     g_type_free_instance ((GTypeInstance*) self);
   }
 }
@@ -221,29 +230,75 @@ const char* gtu_test_object_get_name (GtuTestObject* self) {
 
   priv = PRIVATE (self);
 
-  g_assert (priv->name != NULL);
-  return priv->name;
+  g_assert (priv->name != 0);
+  return g_quark_to_string (priv->name);
+}
+
+GQuark _gtu_test_object_get_name_quark (GtuTestObject* self) {
+  g_assert (GTU_IS_TEST_OBJECT (self));
+  return PRIVATE (self)->name;
+}
+
+/* Paths are built by whichever thread asks for them first, which might be any
+   of several running tests under the same suite, so they're checked and
+   rebuilt under the paths lock. `path' is published before `path_generation',
+   and a thread finding the current generation can use the path without
+   taking the lock. A cached path is only replaced once an ancestor has been
+   given a parent, and trees aren't rearranged while their tests run. */
+G_LOCK_DEFINE_STATIC (paths);
+
+static const GtuPath* get_path_locked (GtuTestObjectPrivate* priv,
+                                       int generation)
+{
+  const GtuPath* parent_path;
+
+  if (priv->path != NULL && priv->path_generation == generation)
+    return priv->path;
+
+  parent_path = priv->parent != NULL ?
+    get_path_locked (PRIVATE (GTU_TEST_OBJECT (priv->parent)), generation) :
+    NULL;
+
+  /* our path holds a reference to the parent path it was built on, so that
+     can't have been freed and its address reused */
+  if (priv->path == NULL || _gtu_path_get_parent (priv->path) != parent_path) {
+    GtuPath* old_path = priv->path;
+
+    g_atomic_pointer_set (&priv->path,
+                          _gtu_path_new_child (parent_path, priv->name));
+
+    if (old_path != NULL)
+      _gtu_path_unref (old_path);
+  }
+
+  g_atomic_int_set (&priv->path_generation, generation);
+
+  return priv->path;
 }
 
 const GtuPath* gtu_test_object_get_path (GtuTestObject* self) {
   GtuTestObjectPrivate* priv;
+  const GtuPath* path;
+  int generation;
 
   g_return_val_if_fail (GTU_IS_TEST_OBJECT (self), NULL);
 
   priv = PRIVATE (self);
 
-  if (priv->path == NULL) {
-    priv->path = gtu_path_new ();
-    gtu_path_append_element (priv->path, priv->name);
+  generation = g_atomic_int_get (&tree_generation);
 
-    if (priv->parent)
-      gtu_path_prepend_path (
-        priv->path,
-        gtu_test_object_get_path (GTU_TEST_OBJECT (priv->parent))
-      );
+  if (g_atomic_int_get (&priv->path_generation) == generation) {
+    path = g_atomic_pointer_get (&priv->path);
+
+    if (path != NULL)
+      return path;
   }
 
-  return priv->path;
+  G_LOCK (paths);
+  path = get_path_locked (priv, generation);
+  G_UNLOCK (paths);
+
+  return path;
 }
 
 const char* gtu_test_object_get_path_string (GtuTestObject* self) {
@@ -256,19 +311,34 @@ GtuTestSuite* gtu_test_object_get_parent_suite (GtuTestObject* self) {
   return PRIVATE (self)->parent;
 }
 
-void _gtu_test_object_emit_ancestry_signal (GtuTestObject* self) {
-  g_signal_emit (self, object_signals[ANCESTRY_CHANGED], 0);
-}
-
 void _gtu_test_object_set_parent_suite (GtuTestObject* self,
                                         GtuTestSuite* suite)
 {
+  GtuTestObjectPrivate* priv;
+
   g_assert (GTU_IS_TEST_OBJECT (self));
   g_assert (GTU_IS_TEST_SUITE (suite));
   g_assert (PRIVATE (self)->parent == NULL);
 
-  PRIVATE (self)->parent = suite;
-  _gtu_test_object_emit_ancestry_signal (self);
+  priv = PRIVATE (self);
+  priv->parent = suite;
+
+  /* Nothing below a test case can have cached a path, so all that's out of
+     date is its own, if it was asked for before it had a parent. Tables'
+     tests are attached while others run, and mustn't send them all back to
+     the lock. */
+  if (GTU_IS_TEST_SUITE (self)) {
+    g_atomic_int_inc (&tree_generation);
+  } else if (priv->path != NULL) {
+    G_LOCK (paths);
+    _gtu_path_unref (priv->path);
+    priv->path = NULL;
+    G_UNLOCK (paths);
+  }
+
+  if (g_signal_has_handler_pending (self, object_signals[ANCESTRY_CHANGED],
+                                    0, false))
+    g_signal_emit (self, object_signals[ANCESTRY_CHANGED], 0);
 }
 
 GtuTestObject* _gtu_test_object_construct (GType type, const char* name) {
@@ -278,7 +348,7 @@ GtuTestObject* _gtu_test_object_construct (GType type, const char* name) {
   g_assert (_gtu_path_element_is_valid (name));
 
   ret = (GtuTestObject*) g_type_create_instance (type);
-  PRIVATE (ret)->name = g_strdup (name);
+  PRIVATE (ret)->name = g_quark_from_string (name);
 
   return ret;
 }
@@ -303,18 +373,6 @@ static void _gtu_test_object_class_init (void* klass, void* data) {
                                 0     /* n_params */);
 }
 
-static void dirty_path (GtuTestObject* self, void* data) {
-  GtuTestObjectPrivate* priv;
-
-  (void) data;
-
-  priv = PRIVATE (self);
-  if (priv->path) {
-    gtu_path_free (priv->path);
-    priv->path = NULL;
-  }
-}
-
 static void _gtu_test_object_init (GTypeInstance* instance, void* klass) {
   GtuTestObject* self = GTU_TEST_OBJECT (instance);
   GtuTestObjectPrivate* priv = PRIVATE (self);
@@ -322,23 +380,15 @@ static void _gtu_test_object_init (GTypeInstance* instance, void* klass) {
   (void) klass;
   priv->ref_count = 1;
   priv->is_floating = 1;
-  priv->has_finalized = false;
-
-  g_signal_connect (instance,
-                    "ancestry-changed",
-                    (GCallback) &dirty_path, NULL);
 }
 
 static void _gtu_test_object_finalize (GtuTestObject* self) {
   GtuTestObjectPrivate* priv = PRIVATE (self);
 
-  g_free (priv->name);
-  priv->name = NULL;
-
   priv->parent = NULL;
 
   if (priv->path) {
-    gtu_path_free (priv->path);
+    _gtu_path_unref (priv->path);
     priv->path = NULL;
   }
 
@@ -346,5 +396,5 @@ static void _gtu_test_object_finalize (GtuTestObject* self) {
      signals, not just GObject. */
   g_signal_handlers_destroy (self);
 
-  priv->has_finalized = true;
+  priv->name = 0;
 }
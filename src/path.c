@@ -1,18 +1,116 @@
 #include <string.h>
 #include "gtu-priv.h"
 
+/* Elements are interned as quarks, so a path is just an array of integers:
+   names shared between tests are only stored once, copies are a memcpy and
+   comparisons don't need to look at any strings.
+
+   Test objects' paths go one step further, holding a reference to their
+   parent's path rather than a copy of its elements, with their own name
+   stored right after the struct. Those paths are persistent; everything else
+   (paths made through the public API) keeps all of its elements itself. */
 struct _GtuPath {
-  GPtrArray* elements;
-  char*      cached_string;
+  GtuPath*     parent;      /* holds our first `length - n_elements' */
+  GQuark*      elements;    /* ...and the rest are here */
+  unsigned     n_elements;
+  unsigned     length;
+  char*        cached_string;
+  volatile int ref_count;
 };
 
+#define PATH_IS_PERSISTENT(path) ((path)->elements == (GQuark*) ((path) + 1))
+
+/* there's one of these for every test object, so they come from the slice
+   allocator rather than each paying for a malloc header */
+#define PERSISTENT_PATH_SIZE (sizeof (GtuPath) + sizeof (GQuark))
+
 GtuPath* gtu_path_new (void) {
   GtuPath* self = g_malloc (sizeof (GtuPath));
-  self->elements = g_ptr_array_new_with_free_func (g_free);
+  self->parent = NULL;
+  self->elements = NULL;
+  self->n_elements = 0;
+  self->length = 0;
   self->cached_string = NULL;
+  self->ref_count = 1;
   return self;
 }
 
+GtuPath* _gtu_path_new_child (const GtuPath* parent, GQuark element) {
+  GtuPath* self = g_slice_alloc (PERSISTENT_PATH_SIZE);
+
+  g_assert (element != 0);
+
+  self->parent = parent != NULL ? _gtu_path_ref ((GtuPath*) parent) : NULL;
+  self->elements = (GQuark*) (self + 1);
+  self->elements[0] = element;
+  self->n_elements = 1;
+  self->length = parent != NULL ? parent->length + 1 : 1;
+  self->cached_string = NULL;
+  self->ref_count = 1;
+
+  return self;
+}
+
+const GtuPath* _gtu_path_get_parent (const GtuPath* path) {
+  return path->parent;
+}
+
+GtuPath* _gtu_path_ref (GtuPath* path) {
+  g_atomic_int_inc (&path->ref_count);
+  return path;
+}
+
+/* copies every element of `path' into `out' */
+static void path_copy_elements (const GtuPath* path, GQuark* out) {
+  for (; path != NULL; path = path->parent)
+    memcpy (&out[path->length - path->n_elements], path->elements,
+            path->n_elements * sizeof (GQuark));
+}
+
+/* Returns all of the elements of `path' in order, to be given back with
+   path_release_elements(). Only persistent paths need to copy them. */
+static const GQuark* path_get_elements (const GtuPath* path) {
+  GQuark* ret;
+
+  if (path->parent == NULL)
+    return path->elements;
+
+  ret = g_new (GQuark, path->length);
+  path_copy_elements (path, ret);
+  return ret;
+}
+
+static void path_release_elements (const GtuPath* path,
+                                   const GQuark* elements)
+{
+  if (elements != path->elements)
+    g_free ((GQuark*) elements);
+}
+
+/* makes room for `n' more elements at `index' */
+static GQuark* path_insert_space (GtuPath* path, unsigned index, unsigned n) {
+  g_assert (!PATH_IS_PERSISTENT (path));
+  g_assert (index <= path->length);
+
+  path->elements = g_renew (GQuark, path->elements, path->length + n);
+  memmove (&path->elements[index + n], &path->elements[index],
+           (path->length - index) * sizeof (GQuark));
+  path->length += n;
+  path->n_elements += n;
+
+  if (path->cached_string != NULL) {
+    g_free (path->cached_string);
+    path->cached_string = NULL;
+  }
+
+  return &path->elements[index];
+}
+
+void _gtu_path_append_quark (GtuPath* path, GQuark element) {
+  g_assert (element != 0);
+  *path_insert_space (path, path->length, 1) = element;
+}
+
 GtuPath* gtu_path_new_parse (const char* path, char** endptr) {
   GtuPath* self = NULL;
   int index = 0;
@@ -29,8 +127,8 @@ GtuPath* gtu_path_new_parse (const char* path, char** endptr) {
       if (element_buf->len == 0)
         goto error;
 
-      g_ptr_array_add (self->elements, g_string_free (element_buf, false));
-      element_buf = g_string_new (NULL);
+      _gtu_path_append_quark (self, g_quark_from_string (element_buf->str));
+      g_string_truncate (element_buf, 0);
 
       continue;
     }
@@ -45,7 +143,8 @@ GtuPath* gtu_path_new_parse (const char* path, char** endptr) {
   if (element_buf->len == 0)
     goto error;
 
-  g_ptr_array_add (self->elements, g_string_free (element_buf, false));
+  _gtu_path_append_quark (self, g_quark_from_string (element_buf->str));
+  g_string_free (element_buf, true);
 
   goto ret;
 
@@ -66,68 +165,95 @@ ret:
 }
 
 static bool path_is_valid_pointer (const GtuPath* path) {
-  return path != NULL && path->elements != NULL;
+  return path != NULL && path->ref_count > 0;
+}
+
+/* the paths of test objects can't be changed through the public API */
+static bool path_is_mutable (const GtuPath* path) {
+  return path_is_valid_pointer (path) && !PATH_IS_PERSISTENT (path);
 }
 
 GtuPath* gtu_path_copy (const GtuPath* path) {
-  unsigned i;
   GtuPath* ret;
 
   g_return_val_if_fail (path_is_valid_pointer (path), NULL);
 
   ret = gtu_path_new ();
-  g_ptr_array_set_size (ret->elements, path->elements->len);
 
-  for (i = 0; i < ret->elements->len; i++)
-    ret->elements->pdata[i] = g_strdup (path->elements->pdata[i]);
+  if (path->length > 0) {
+    ret->elements = g_new (GQuark, path->length);
+    ret->n_elements = ret->length = path->length;
+    path_copy_elements (path, ret->elements);
+  }
 
   return ret;
 }
 
-void gtu_path_free (GtuPath* path) {
-  g_return_if_fail (path_is_valid_pointer (path));
+void _gtu_path_unref (GtuPath* path) {
+  if (!g_atomic_int_dec_and_test (&path->ref_count))
+    return;
 
-  g_ptr_array_free (path->elements, true);
-  path->elements = NULL;
+  g_free (path->cached_string);
 
-  if (path->cached_string) {
-    g_free (path->cached_string);
-    path->cached_string = NULL;
+  if (path->parent != NULL)
+    _gtu_path_unref (path->parent);
+
+  if (PATH_IS_PERSISTENT (path)) {
+    g_slice_free1 (PERSISTENT_PATH_SIZE, path);
+  } else {
+    g_free (path->elements);
+    g_free (path);
   }
+}
 
-  g_free (path);
+void gtu_path_free (GtuPath* path) {
+  g_return_if_fail (path_is_mutable (path));
+  _gtu_path_unref (path);
 }
 
 /* There should be only one way to construct an invalid GtuPath instance, and
    that's by making an empty path with gtu_path_new(). So just testing the
-   length of `elements' should be enough. */
+   length should be enough. */
 bool gtu_path_is_valid (const GtuPath* path) {
   g_return_val_if_fail (path_is_valid_pointer (path), false);
-  return path->elements->len > 0;
+  return path->length > 0;
 }
 
-/* we lie about `path' being const just to make the API simpler */
+/* We lie about `path' being const just to make the API simpler. The string is
+   built from the parent's (itself cached), and may be built by several
+   threads at once; the first to finish wins. */
 const char* gtu_path_to_string (const GtuPath* _path) {
   unsigned i;
   GString* ret_buffer;
   GtuPath* path;
+  char* string;
 
   g_return_val_if_fail (gtu_path_is_valid (_path), NULL);
   path = (GtuPath*) _path;
 
-  if (path->cached_string == NULL) {
-    for (i = 0, ret_buffer = g_string_new (NULL);
-         i < path->elements->len;
-         i++)
-    {
-      g_string_append_c (ret_buffer, '/');
-      g_string_append (ret_buffer, path->elements->pdata[i]);
-    }
+  string = g_atomic_pointer_get (&path->cached_string);
+  if (string != NULL)
+    return string;
+
+  ret_buffer = g_string_new (path->parent != NULL ?
+                               gtu_path_to_string (path->parent) :
+                               NULL);
+
+  for (i = 0; i < path->n_elements; i++) {
+    g_string_append_c (ret_buffer, '/');
+    g_string_append (ret_buffer, g_quark_to_string (path->elements[i]));
+  }
+
+  string = g_string_free (ret_buffer, false);
 
-    path->cached_string = g_string_free (ret_buffer, false);
+  if (!g_atomic_pointer_compare_and_exchange (&path->cached_string,
+                                              NULL, string))
+  {
+    g_free (string);
+    string = g_atomic_pointer_get (&path->cached_string);
   }
 
-  return path->cached_string;
+  return string;
 }
 
 bool _gtu_path_element_is_valid (const char* element) {
@@ -144,73 +270,80 @@ bool _gtu_path_element_is_valid (const char* element) {
 }
 
 void gtu_path_prepend_element (GtuPath* path, const char* element) {
-  g_return_if_fail (path_is_valid_pointer (path));
+  g_return_if_fail (path_is_mutable (path));
   g_return_if_fail (_gtu_path_element_is_valid (element));
-  g_ptr_array_insert (path->elements, 0, g_strdup (element));
+  *path_insert_space (path, 0, 1) = g_quark_from_string (element);
 }
 
 void gtu_path_append_element (GtuPath* path, const char* element) {
-  g_return_if_fail (path_is_valid_pointer (path));
+  g_return_if_fail (path_is_mutable (path));
   g_return_if_fail (_gtu_path_element_is_valid (element));
-  g_ptr_array_add (path->elements, g_strdup (element));
+  _gtu_path_append_quark (path, g_quark_from_string (element));
 }
 
 void gtu_path_prepend_path (GtuPath* path, const GtuPath* to_prepend) {
-  unsigned i;
+  unsigned length;
+  GQuark* space;
 
-  g_return_if_fail (path_is_valid_pointer (path));
+  g_return_if_fail (path_is_mutable (path));
   g_return_if_fail (path_is_valid_pointer (to_prepend));
 
-  for (i = 0; i < to_prepend->elements->len; i++)
-    g_ptr_array_insert (path->elements,
-                        (int) i,
-                        g_strdup (to_prepend->elements->pdata[i]));
+  length = to_prepend->length;
+  space = path_insert_space (path, 0, length);
+
+  /* `to_prepend' may be `path', whose elements have just been moved up */
+  if (to_prepend == path)
+    memcpy (space, space + length, length * sizeof (GQuark));
+  else
+    path_copy_elements (to_prepend, space);
 }
 
 void gtu_path_append_path (GtuPath* path, const GtuPath* to_append) {
-  unsigned i;
+  unsigned length;
+  GQuark* space;
 
-  g_return_if_fail (path_is_valid_pointer (path));
+  g_return_if_fail (path_is_mutable (path));
   g_return_if_fail (path_is_valid_pointer (to_append));
 
-  for (i = 0; i < to_append->elements->len; i++)
-    g_ptr_array_add (path->elements, g_strdup (to_append->elements->pdata[i]));
+  length = to_append->length;
+  space = path_insert_space (path, path->length, length);
+
+  /* likewise, `to_append' may be `path'; the elements we want are still where
+     they were */
+  if (to_append == path)
+    memcpy (space, path->elements, length * sizeof (GQuark));
+  else
+    path_copy_elements (to_append, space);
 }
 
 bool gtu_path_has_prefix (const GtuPath* path, const GtuPath* prefix) {
-  unsigned i;
+  const GtuPath* ancestor;
+  const GQuark* path_elements;
+  const GQuark* prefix_elements;
+  bool ret;
 
   g_return_val_if_fail (path_is_valid_pointer (path),   false);
   g_return_val_if_fail (path_is_valid_pointer (prefix), false);
 
-  if (path->elements->len < prefix->elements->len)
+  if (path->length < prefix->length)
     return false;
 
-  for (i = 0; i < prefix->elements->len; i++)
-    if (strcmp (path->elements->pdata[i], prefix->elements->pdata[i]) != 0)
-      return false;
+  /* the usual case for test objects: `prefix' is one of our ancestors */
+  for (ancestor = path;
+       ancestor != NULL && ancestor->length > prefix->length;
+       ancestor = ancestor->parent);
 
-  return true;
-}
+  if (ancestor == prefix)
+    return true;
 
-bool _gtu_path_should_run (const GtuPath* path) {
-  bool should_run = true;
-  GtuTestMode* test_mode = _gtu_get_test_mode ();
-  GList* cursor;
+  path_elements = path_get_elements (path);
+  prefix_elements = path_get_elements (prefix);
 
-  for (cursor = test_mode->path_selectors;
-       cursor != NULL && should_run;
-       cursor = cursor->next)
-  {
-    should_run = gtu_path_has_prefix (path, cursor->data);
-  }
+  ret = memcmp (path_elements, prefix_elements,
+                prefix->length * sizeof (GQuark)) == 0;
 
-  for (cursor = test_mode->path_skippers;
-       cursor != NULL && should_run;
-       cursor = cursor->next)
-  {
-    should_run = !gtu_path_has_prefix (path, cursor->data);
-  }
+  path_release_elements (path, path_elements);
+  path_release_elements (prefix, prefix_elements);
 
-  return should_run;
+  return ret;
 }
@@ -0,0 +1,419 @@
+#include <string.h>
+#include "gtu-priv.h"
+
+/* -p and -s arguments are compiled into one automaton over path elements.
+
+   Every argument is added to a trie of GtuSelectorNodes, which is a
+   nondeterministic automaton: a node can have a child for an exact element,
+   one for `*' (any one element), one for `**' (any number of elements,
+   including none, so it loops on itself) and any number for `~regex'
+   elements. A path is selected if some prefix of it (itself included) ends
+   at a node for a -p argument, or if there are no -p arguments at all; it's
+   skipped if a prefix ends at a node for a -s argument.
+
+   The trie is walked a set of nodes at a time. Each set is turned into a
+   GtuSelectorState the first time it's reached, and every state remembers
+   where each element it's seen leads, so walking the tree mostly costs a
+   hash lookup per element. Elements that no node in the set names exactly
+   all lead to the same place, unless there's a regex to ask, so most states
+   only remember a handful of transitions however big the tree. */
+
+typedef struct _GtuSelectorState GtuSelectorState;
+
+typedef struct {
+  char*            pattern;
+  GRegex*          regex;
+  GtuSelectorNode* node;
+} RegexEdge;
+
+struct _GtuSelectorNode {
+  GHashTable*      children;       /* element quark -> GtuSelectorNode */
+  GtuSelectorNode* any_child;      /* `*' */
+  GtuSelectorNode* deep_child;     /* `**' */
+  GPtrArray*       regex_children; /* of RegexEdge */
+  bool             loops;          /* if we're a `**' node */
+  bool             selected;
+  bool             skipped;
+};
+
+struct _GtuSelectorState {
+  GtuSelectorNode** nodes; /* sorted, and including every `**' node the
+                              others lead to without consuming anything */
+  unsigned          n_nodes;
+  bool              selected;
+  bool              skipped;
+  bool              has_regex;
+
+  /* Every element named exactly by one of `nodes', leading to the state it
+     steps to or NULL until we've worked it out. With `has_regex', any other
+     element we've seen is added too. */
+  GHashTable*       transitions;
+  GtuSelectorState* other; /* for everything else, without `has_regex' */
+};
+
+/* interned states, keyed by their nodes */
+static GHashTable* states = NULL;
+static GtuSelectorState* start_state = NULL;
+
+/* cursors are used from whichever thread runs a test, and the states are
+   filled in as they go */
+G_LOCK_DEFINE_STATIC (states);
+
+static GtuSelectorNode* node_new (void) {
+  return g_new0 (GtuSelectorNode, 1);
+}
+
+static GtuSelectorNode* node_get_child (GtuSelectorNode* node, GQuark element) {
+  void* key = GUINT_TO_POINTER (element);
+  GtuSelectorNode* child;
+
+  if (node->children == NULL)
+    node->children = g_hash_table_new (NULL, NULL);
+
+  child = g_hash_table_lookup (node->children, key);
+
+  if (child == NULL) {
+    child = node_new ();
+    g_hash_table_insert (node->children, key, child);
+  }
+
+  return child;
+}
+
+static GtuSelectorNode* node_get_regex_child (GtuSelectorNode* node,
+                                              const char* pattern,
+                                              GError** error)
+{
+  RegexEdge* edge;
+  char* anchored;
+  GRegex* regex;
+  unsigned i;
+
+  if (node->regex_children == NULL)
+    node->regex_children = g_ptr_array_new ();
+
+  for (i = 0; i < node->regex_children->len; i++) {
+    edge = node->regex_children->pdata[i];
+
+    if (strcmp (edge->pattern, pattern) == 0)
+      return edge->node;
+  }
+
+  /* the regex has to match the whole element */
+  anchored = g_strdup_printf ("^(?:%s)$", pattern);
+  regex = g_regex_new (anchored, G_REGEX_OPTIMIZE | G_REGEX_DOLLAR_ENDONLY, 0,
+                       error);
+  g_free (anchored);
+
+  if (regex == NULL)
+    return NULL;
+
+  edge = g_new (RegexEdge, 1);
+  edge->pattern = g_strdup (pattern);
+  edge->regex = regex;
+  edge->node = node_new ();
+  g_ptr_array_add (node->regex_children, edge);
+
+  return edge->node;
+}
+
+static void node_mark (GtuSelectorNode* node,
+                       GtuTestMode* test_mode,
+                       bool skip)
+{
+  if (skip) {
+    node->skipped = true;
+  } else {
+    node->selected = true;
+    test_mode->has_path_selectors = true;
+  }
+}
+
+bool _gtu_selector_add (GtuTestMode* test_mode,
+                        const char* selector,
+                        size_t length,
+                        bool skip,
+                        const char** endptr,
+                        GError** error)
+{
+  static GString* text = NULL;
+  GtuSelectorNode* node;
+  const char* end = selector + length;
+  const char* element = selector + 1;
+
+  g_assert (start_state == NULL);
+
+  if (length == 0 || selector[0] != '/') {
+    *endptr = selector + 1;
+    return false;
+  }
+
+  /* reused between arguments, since there might be a lot of them */
+  if (text == NULL)
+    text = g_string_new (NULL);
+
+  if (test_mode->path_selectors == NULL)
+    test_mode->path_selectors = node_new ();
+
+  node = test_mode->path_selectors;
+
+  /* Nodes made for an argument we go on to reject are left in the trie.
+     They don't end any argument, so they can't change what's selected. */
+  for (;;) {
+    const char* element_end = element;
+
+    for (; element_end < end && *element_end != '/'; element_end++) {
+      if (g_ascii_isspace (*element_end)) {
+        *endptr = element_end + 1;
+        return false;
+      }
+    }
+
+    g_string_truncate (text, 0);
+    g_string_append_len (text, element, element_end - element);
+
+    if (text->len == 0 || strcmp (text->str, "~") == 0) {
+      *endptr = element + 1;
+      return false;
+    }
+
+    if (strcmp (text->str, "*") == 0) {
+      if (node->any_child == NULL)
+        node->any_child = node_new ();
+
+      node = node->any_child;
+
+    } else if (strcmp (text->str, "**") == 0) {
+      if (node->deep_child == NULL) {
+        node->deep_child = node_new ();
+        node->deep_child->loops = true;
+      }
+
+      node = node->deep_child;
+
+    } else if (text->str[0] == '~') {
+      node = node_get_regex_child (node, text->str + 1, error);
+
+    } else {
+      node = node_get_child (node, g_quark_from_string (text->str));
+    }
+
+    if (node == NULL) {
+      *endptr = element + 1;
+      return false;
+    }
+
+    if (element_end == end)
+      break;
+
+    element = element_end + 1;
+  }
+
+  node_mark (node, test_mode, skip);
+
+  return true;
+}
+
+static int compare_nodes (const void* a, const void* b) {
+  const GtuSelectorNode* node_a = *(GtuSelectorNode* const*) a;
+  const GtuSelectorNode* node_b = *(GtuSelectorNode* const*) b;
+
+  return node_a < node_b ? -1 : node_a > node_b;
+}
+
+static void add_node (GPtrArray* nodes, GtuSelectorNode* node) {
+  if (node != NULL)
+    g_ptr_array_add (nodes, node);
+}
+
+/* Takes `nodes', adds the `**' nodes they lead to without consuming an
+   element, and finds or makes the state for them. */
+static GtuSelectorState* state_get (GPtrArray* nodes) {
+  GtuSelectorState* state;
+  GBytes* key;
+  unsigned i, n_unique;
+
+  for (i = 0; i < nodes->len; i++)
+    add_node (nodes, ((GtuSelectorNode*) nodes->pdata[i])->deep_child);
+
+  qsort (nodes->pdata, nodes->len, sizeof (void*), &compare_nodes);
+
+  for (i = 0, n_unique = 0; i < nodes->len; i++)
+    if (n_unique == 0 || nodes->pdata[n_unique - 1] != nodes->pdata[i])
+      nodes->pdata[n_unique++] = nodes->pdata[i];
+
+  g_ptr_array_set_size (nodes, n_unique);
+
+  key = g_bytes_new (nodes->pdata, n_unique * sizeof (void*));
+
+  if (states == NULL)
+    states = g_hash_table_new (&g_bytes_hash, &g_bytes_equal);
+
+  state = g_hash_table_lookup (states, key);
+
+  if (state != NULL) {
+    g_bytes_unref (key);
+    g_ptr_array_free (nodes, true);
+    return state;
+  }
+
+  state = g_new0 (GtuSelectorState, 1);
+  state->n_nodes = nodes->len;
+  state->nodes = (GtuSelectorNode**) g_ptr_array_free (nodes, false);
+  state->transitions = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < state->n_nodes; i++) {
+    GtuSelectorNode* node = state->nodes[i];
+
+    state->selected |= node->selected;
+    state->skipped |= node->skipped;
+    state->has_regex |= node->regex_children != NULL;
+
+    if (node->children != NULL) {
+      GHashTableIter iter;
+      void* element;
+
+      g_hash_table_iter_init (&iter, node->children);
+      while (g_hash_table_iter_next (&iter, &element, NULL))
+        g_hash_table_insert (state->transitions, element, NULL);
+    }
+  }
+
+  g_hash_table_insert (states, key, state);
+
+  return state;
+}
+
+/* `element' is 0 if it isn't named exactly by any node, in which case `name'
+   is only needed if there's a regex to match it against */
+static GtuSelectorState* state_compute_step (const GtuSelectorState* state,
+                                             GQuark element,
+                                             const char* name)
+{
+  GPtrArray* nodes = g_ptr_array_new ();
+  unsigned i, j;
+
+  for (i = 0; i < state->n_nodes; i++) {
+    GtuSelectorNode* node = state->nodes[i];
+
+    if (element != 0 && node->children != NULL)
+      add_node (nodes, g_hash_table_lookup (node->children,
+                                            GUINT_TO_POINTER (element)));
+
+    add_node (nodes, node->any_child);
+
+    if (node->loops)
+      add_node (nodes, node);
+
+    for (j = 0; node->regex_children != NULL &&
+                j < node->regex_children->len; j++)
+    {
+      RegexEdge* edge = node->regex_children->pdata[j];
+
+      if (g_regex_match (edge->regex, name, 0, NULL))
+        add_node (nodes, edge->node);
+    }
+  }
+
+  return state_get (nodes);
+}
+
+/* `name' is only used if `element' is 0 */
+static GtuSelectorState* state_step (GtuSelectorState* state,
+                                     GQuark element,
+                                     const char* name)
+{
+  void* key = GUINT_TO_POINTER (element);
+  void* next;
+
+  if (element != 0 &&
+      g_hash_table_lookup_extended (state->transitions, key, NULL, &next))
+  {
+    if (next == NULL) {
+      next = state_compute_step (state, element,
+                                 g_quark_to_string (element));
+      g_hash_table_insert (state->transitions, key, next);
+    }
+
+    return next;
+  }
+
+  if (!state->has_regex) {
+    if (state->other == NULL)
+      state->other = state_compute_step (state, 0, NULL);
+
+    return state->other;
+  }
+
+  if (element != 0)
+    name = g_quark_to_string (element);
+
+  next = state_compute_step (state, element, name);
+
+  /* an element that was never interned can't be looked up later anyway */
+  if (element != 0)
+    g_hash_table_insert (state->transitions, key, next);
+
+  return next;
+}
+
+void _gtu_selector_cursor_init (GtuSelectorCursor* cursor) {
+  GtuTestMode* test_mode = _gtu_get_test_mode ();
+
+  cursor->state = NULL;
+  cursor->selected = !test_mode->has_path_selectors;
+  cursor->skipped = false;
+
+  if (test_mode->path_selectors == NULL)
+    return;
+
+  G_LOCK (states);
+
+  if (start_state == NULL) {
+    GPtrArray* nodes = g_ptr_array_new ();
+
+    g_ptr_array_add (nodes, test_mode->path_selectors);
+    start_state = state_get (nodes);
+  }
+
+  G_UNLOCK (states);
+
+  cursor->state = start_state;
+}
+
+static void cursor_step (GtuSelectorCursor* cursor,
+                         GQuark element,
+                         const char* name)
+{
+  GtuSelectorState* next;
+
+  /* also covers anything under a -s path, where there's nothing left to
+     decide */
+  if (cursor->state == NULL || cursor->skipped)
+    return;
+
+  G_LOCK (states);
+  next = state_step ((GtuSelectorState*) cursor->state, element, name);
+  G_UNLOCK (states);
+
+  cursor->selected |= next->selected;
+  cursor->skipped |= next->skipped;
+  cursor->state = next->n_nodes > 0 ? next : NULL;
+}
+
+void _gtu_selector_cursor_step (GtuSelectorCursor* cursor, GQuark element) {
+  cursor_step (cursor, element, NULL);
+}
+
+void _gtu_selector_cursor_step_name (GtuSelectorCursor* cursor,
+                                     const char* name)
+{
+  if (cursor->state == NULL || cursor->skipped)
+    return;
+
+  cursor_step (cursor, g_quark_try_string (name), name);
+}
+
+bool _gtu_selector_cursor_should_run (const GtuSelectorCursor* cursor) {
+  return cursor->selected && !cursor->skipped;
+}
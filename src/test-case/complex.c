@@ -1,9 +1,12 @@
 #include "priv-complex.h"
 #include "priv-setjmp.h"
 #include "log/logio.h"
+#include "log/log-glib.h"
 
 typedef struct {
   GEnumClass* subunit_enum_class;
+  bool*       subunit_selected; /* by -p and -s; NULL if they all are */
+  unsigned    n_selected;
 } GtuComplexCasePrivate;
 
 #define PRIVATE(obj) \
@@ -28,6 +31,9 @@ static void gtu_complex_case_finalize (GtuTestObject* self) {
   g_type_class_unref (priv->subunit_enum_class);
   priv->subunit_enum_class = NULL;
 
+  g_free (priv->subunit_selected);
+  priv->subunit_selected = NULL;
+
   GTU_TEST_OBJECT_CLASS (gtu_complex_case_parent_class)->finalize (self);
 }
 
@@ -61,6 +67,8 @@ GtuComplexCase* gtu_complex_case_construct (GType type,
   self = GTU_COMPLEX_CASE (gtu_test_case_construct (type, name));
   PRIVATE (self)->subunit_enum_class =
     G_ENUM_CLASS (g_type_class_ref (subunit_enum_type));
+  PRIVATE (self)->subunit_selected = NULL;
+  PRIVATE (self)->n_selected = PRIVATE (self)->subunit_enum_class->n_values;
 
   if (!check_enum_names (self)) {
     gtu_test_object_unref (self);
@@ -89,73 +97,274 @@ void run_inner (void* data) {
   );
 }
 
-/* TODO: communicate number of failed subunits to the GtuTestSuite runner */
-GtuTestResult _gtu_complex_case_run (GtuComplexCase* self, char** out_message) {
-  unsigned i;
+bool _gtu_complex_case_select_subunits (GtuComplexCase* self,
+                                        const GtuSelectorCursor* cursor)
+{
+  GtuComplexCasePrivate* priv;
   GEnumClass* enum_class;
-  ComplexRunContext context = { NULL, 0 };
+  unsigned i;
+
+  g_assert (GTU_IS_COMPLEX_CASE (self));
+  priv = PRIVATE (self);
+  enum_class = priv->subunit_enum_class;
+
+  if (enum_class->n_values == 0)
+    return _gtu_selector_cursor_should_run (cursor);
+
+  g_free (priv->subunit_selected);
+  priv->subunit_selected = g_new (bool, enum_class->n_values);
+  priv->n_selected = 0;
+
+  for (i = 0; i < enum_class->n_values; i++) {
+    GtuSelectorCursor subunit_cursor = *cursor;
+
+    _gtu_selector_cursor_step_name (&subunit_cursor,
+                                    enum_class->values[i].value_nick);
+
+    priv->subunit_selected[i] =
+      _gtu_selector_cursor_should_run (&subunit_cursor);
+
+    if (priv->subunit_selected[i])
+      priv->n_selected++;
+  }
+
+  if (priv->n_selected == enum_class->n_values) {
+    g_free (priv->subunit_selected);
+    priv->subunit_selected = NULL;
+  }
+
+  return priv->n_selected > 0;
+}
+
+static GtuTestResult run_subunit (ComplexRunContext* context,
+                                  char** message,
+                                  GtuLogTestDetails* details)
+{
+  GtuTestResult result;
+
+  gtu_log_test_details_begin (details);
+  result = _gtu_test_case_exec_inner (GTU_TEST_CASE (context->self),
+                                      &run_inner, context,
+                                      message, details);
+  gtu_log_test_details_end (details);
+
+  return result;
+}
+
+static void report_subunit (GtuComplexCase* self,
+                            const GEnumValue* value,
+                            GtuTestResult result,
+                            const char* message,
+                            const GtuLogTestDetails* details)
+{
+  GtuPath* temp_path;
+
+  temp_path = gtu_path_copy (gtu_test_object_get_path (GTU_TEST_OBJECT (self)));
+  gtu_path_append_element (temp_path, value->value_nick);
+
+  switch (result) {
+    case GTU_TEST_RESULT_PASS:
+      gtu_log_test_success (gtu_path_to_string (temp_path), message, details);
+      break;
+
+    case GTU_TEST_RESULT_SKIP:
+      gtu_log_test_skipped (gtu_path_to_string (temp_path), message, details);
+      break;
+
+    case GTU_TEST_RESULT_FAIL:
+      /* message may be NULL if we're skipping the last tests */
+      gtu_log_test_failed (gtu_path_to_string (temp_path),
+                           message != NULL ?
+                             message :
+                             "Previous subunit failed",
+                           details);
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+
+  gtu_path_free (temp_path);
+}
+
+/* Subunits of a class with `concurrent_subunits' set are handed to a pool of
+   their own, one SubunitJob each, and reported in order as they come in with
+   whatever they logged held back until then; much like run.c does with
+   parallel-safe tests. */
+typedef struct {
+  ComplexRunContext context;
+  const GEnumValue* value;
+  GtuLogCapture*    capture;
+  GtuTestResult     result;
+  char*             message;
+  GtuLogTestDetails details;
+  bool              done;    /* protected by `subunits_lock' */
+} SubunitJob;
+
+static GMutex subunits_lock;
+static GCond subunit_done;
+
+static void run_subunit_job (SubunitJob* job, void* user_data) {
+  (void) user_data;
+
+  gtu_log_capture_set_thread (job->capture);
+  gtu_log_g_begin_thread_test ();
+
+  job->result = run_subunit (&job->context, &job->message, &job->details);
+
+  gtu_log_g_end_test ();
+  gtu_log_capture_set_thread (NULL);
+
+  g_mutex_lock (&subunits_lock);
+  job->done = true;
+  g_cond_broadcast (&subunit_done);
+  g_mutex_unlock (&subunits_lock);
+}
+
+/* Returns how many threads to run the selected subunits of `self' on, or 1
+   if they should run one after another. */
+static unsigned get_n_threads (GtuComplexCase* self) {
+  unsigned n_jobs = _gtu_get_test_mode ()->n_jobs;
 
+  if (!GTU_COMPLEX_CASE_GET_CLASS (self)->concurrent_subunits)
+    return 1;
+
+  if (n_jobs == 0)
+    n_jobs = g_get_num_processors ();
+
+  return MIN (n_jobs, PRIVATE (self)->n_selected);
+}
+
+static GtuTestResult run_concurrently (GtuComplexCase* self,
+                                       unsigned n_threads,
+                                       unsigned* n_skipped)
+{
+  GtuComplexCasePrivate* priv = PRIVATE (self);
+  GEnumClass* enum_class = priv->subunit_enum_class;
   GtuTestResult result = GTU_TEST_RESULT_INVALID;
-  unsigned n_skipped = 0;
+  GThreadPool* pool;
+  SubunitJob* jobs;
+  unsigned i, n_jobs = 0;
 
-  const GtuPath* our_path;
+  pool = g_thread_pool_new ((GFunc) &run_subunit_job, NULL, (int) n_threads,
+                            false, NULL);
+  jobs = g_new0 (SubunitJob, priv->n_selected);
 
-  g_assert (GTU_IS_COMPLEX_CASE (self));
-  enum_class = PRIVATE (self)->subunit_enum_class;
-  g_assert (G_IS_ENUM_CLASS (enum_class));
+  for (i = 0; i < enum_class->n_values; i++) {
+    SubunitJob* job;
+
+    if (priv->subunit_selected != NULL && !priv->subunit_selected[i])
+      continue;
+
+    job = &jobs[n_jobs++];
+    job->context.self = self;
+    job->context.enum_value = enum_class->values[i].value;
+    job->value = &enum_class->values[i];
+    job->capture = gtu_log_capture_new ();
+    g_thread_pool_push (pool, job, NULL);
+  }
+
+  for (i = 0; i < n_jobs; i++) {
+    SubunitJob* job = &jobs[i];
+    bool failed;
+
+    g_mutex_lock (&subunits_lock);
+    while (!job->done)
+      g_cond_wait (&subunit_done, &subunits_lock);
+    g_mutex_unlock (&subunits_lock);
+
+    failed = job->result != GTU_TEST_RESULT_PASS;
+
+    /* the subunit's result has to come after its diagnostics, and after
+       anything logged from here in the meantime. If it failed badly enough
+       to end the run, finishing its capture is where that happens. */
+    gtu_log_g_end_test ();
+    gtu_log_capture_end (failed);
+    gtu_log_capture_finish (job->capture, failed);
+
+    report_subunit (self, job->value, job->result, job->message,
+                    &job->details);
+
+    if (job->result == GTU_TEST_RESULT_SKIP)
+      (*n_skipped)++;
+
+    /* they're independent, so one failing doesn't mean the rest do */
+    if (result != GTU_TEST_RESULT_FAIL)
+      result = job->result;
+
+    g_free (job->message);
+
+    gtu_log_capture_begin ();
+  }
+
+  g_thread_pool_free (pool, false, true);
+  g_free (jobs);
+
+  return result;
+}
+
+static GtuTestResult run_serially (GtuComplexCase* self, unsigned* n_skipped) {
+  GtuComplexCasePrivate* priv = PRIVATE (self);
+  GEnumClass* enum_class = priv->subunit_enum_class;
+  GtuTestResult result = GTU_TEST_RESULT_INVALID;
+  ComplexRunContext context = { NULL, 0 };
+  unsigned i;
 
   context.self = self;
-  our_path = gtu_test_object_get_path (GTU_TEST_OBJECT (self));
 
   for (i = 0; i < enum_class->n_values; i++) {
-    GtuPath* temp_path;
     char* message = NULL;
+    GtuLogTestDetails details = { 0, 0, 0, 0, false, NULL, NULL, NULL };
     GEnumValue* value = &enum_class->values[i];
 
-    context.enum_value = value->value;
-
-    temp_path = gtu_path_copy (our_path);
-    gtu_path_append_element (temp_path, value->value_nick);
+    /* left out by -p or -s, and not counted in the plan */
+    if (priv->subunit_selected != NULL && !priv->subunit_selected[i])
+      continue;
 
-    if (!_gtu_path_should_run (temp_path)) {
-      g_message ("Ignoring skip arguments: %s",
-                 "cannot skip individual subunits of a complex test case");
-    }
+    context.enum_value = value->value;
 
     if (result != GTU_TEST_RESULT_FAIL)
-      result = _gtu_test_case_exec_inner (&run_inner, &context, &message);
-
-    switch (result) {
-      case GTU_TEST_RESULT_PASS:
-        gtu_log_test_success (gtu_path_to_string (temp_path), message);
-        break;
-
-      case GTU_TEST_RESULT_SKIP:
-        gtu_log_test_skipped (gtu_path_to_string (temp_path), message);
-        n_skipped++;
-        break;
+      result = run_subunit (&context, &message, &details);
 
-      case GTU_TEST_RESULT_FAIL:
-        /* message may be NULL if we're skipping the last tests */
-        gtu_log_test_failed (gtu_path_to_string (temp_path),
-                             message != NULL ?
-                               message :
-                               "Previous subunit failed");
-        break;
+    /* the subunit's result has to come after its diagnostics */
+    gtu_log_g_end_test ();
+    gtu_log_capture_end (result != GTU_TEST_RESULT_PASS);
 
-      default:
-        g_assert_not_reached ();
-    }
+    report_subunit (self, value, result, message, &details);
 
-    gtu_path_free (temp_path);
+    if (result == GTU_TEST_RESULT_SKIP)
+      (*n_skipped)++;
 
     if (message != NULL)
       g_free (message);
+
+    gtu_log_capture_begin ();
   }
 
+  return result;
+}
+
+/* TODO: communicate number of failed subunits to the GtuTestSuite runner */
+GtuTestResult _gtu_complex_case_run (GtuComplexCase* self, char** out_message) {
+  GtuComplexCasePrivate* priv;
+  GtuTestResult result;
+  unsigned n_threads;
+  unsigned n_skipped = 0;
+
+  g_assert (GTU_IS_COMPLEX_CASE (self));
+  priv = PRIVATE (self);
+  g_assert (G_IS_ENUM_CLASS (priv->subunit_enum_class));
+
+  n_threads = get_n_threads (self);
+
+  if (n_threads > 1)
+    result = run_concurrently (self, n_threads, &n_skipped);
+  else
+    result = run_serially (self, &n_skipped);
+
   switch (result) {
     case GTU_TEST_RESULT_SKIP:
-      if (n_skipped != enum_class->n_values)
+      if (n_skipped != priv->n_selected)
         break;
 
       *out_message = g_strdup ("All subunits were skipped");
@@ -176,5 +385,5 @@ GtuTestResult _gtu_complex_case_run (GtuComplexCase* self, char** out_message) {
 }
 
 unsigned _gtu_complex_case_get_length (GtuComplexCase* self) {
-  return PRIVATE (self)->subunit_enum_class->n_values;
+  return PRIVATE (self)->n_selected;
 }
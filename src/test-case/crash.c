@@ -0,0 +1,183 @@
+#define _XOPEN_SOURCE 700
+
+#include <signal.h>
+#include <string.h>
+
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+
+#include "log/logio.h"
+#include "test-case/priv-setjmp.h"
+
+/* Crashes are turned into failures by catching the signal on an alternate
+   stack (the test's own might be what's broken), noting down where we were,
+   and jumping back out of the test. Everything the handler does has to be
+   async-signal-safe, so the report is written into memory set aside for the
+   thread beforehand and only formatted once we're out. */
+
+#define ALT_STACK_SIZE (64 * 1024)
+#define MAX_FRAMES     32
+#define MAX_NAME       64
+
+typedef struct {
+  unw_word_t ip;
+  unw_word_t offset;
+  char name[MAX_NAME]; /* empty if libunwind couldn't tell us */
+} CrashFrame;
+
+typedef struct {
+  void* alt_stack;
+  volatile sig_atomic_t crashing;
+
+  int signo;
+  void* address;
+  unsigned n_frames;
+  CrashFrame frames[MAX_FRAMES];
+} CrashGuard;
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE };
+
+static bool enabled = false;
+
+static void crash_guard_free (void* data) {
+  CrashGuard* guard = data;
+  stack_t disable;
+
+  memset (&disable, 0, sizeof (stack_t));
+  disable.ss_flags = SS_DISABLE;
+  sigaltstack (&disable, NULL);
+
+  g_free (guard->alt_stack);
+  g_free (guard);
+}
+
+static GPrivate thread_guard = G_PRIVATE_INIT (&crash_guard_free);
+
+static void record_backtrace (CrashGuard* guard) {
+  unw_context_t context;
+  unw_cursor_t cursor;
+  bool found_signal_frame = false;
+
+  guard->n_frames = 0;
+
+  if (unw_getcontext (&context) != 0 || unw_init_local (&cursor, &context) != 0)
+    return;
+
+  /* skip over ourselves, up to and including the signal trampoline */
+  do {
+    if (unw_is_signal_frame (&cursor) > 0) {
+      found_signal_frame = true;
+      break;
+    }
+  } while (unw_step (&cursor) > 0);
+
+  if (!found_signal_frame || unw_step (&cursor) <= 0)
+    return;
+
+  do {
+    CrashFrame* frame = &guard->frames[guard->n_frames];
+
+    if (unw_get_reg (&cursor, UNW_REG_IP, &frame->ip) != 0)
+      break;
+
+    if (unw_get_proc_name (&cursor, frame->name, MAX_NAME,
+                           &frame->offset) != 0)
+    {
+      frame->name[0] = '\0';
+      frame->offset = 0;
+    }
+
+    guard->n_frames++;
+  } while (guard->n_frames < MAX_FRAMES && unw_step (&cursor) > 0);
+}
+
+static void crash_handler (int signo, siginfo_t* info, void* ucontext) {
+  CrashGuard* guard = g_private_get (&thread_guard);
+  sigset_t unblock;
+
+  (void) ucontext;
+
+  /* Not ours to deal with: a crash outside of a test, one in here, or a
+     signal somebody sent on purpose. Let it take the process down as it
+     would have without us. */
+  if (guard == NULL || guard->crashing || info->si_code <= 0 ||
+      _gtu_get_tr_context () == NULL)
+  {
+    signal (signo, SIG_DFL);
+    raise (signo);
+    return;
+  }
+
+  guard->crashing = true;
+  guard->signo = signo;
+  guard->address = info->si_addr;
+  record_backtrace (guard);
+
+  /* the jump skips the kernel's restoring of our signal mask */
+  sigemptyset (&unblock);
+  sigaddset (&unblock, signo);
+  sigprocmask (SIG_UNBLOCK, &unblock, NULL);
+
+  _gtu_test_preempt_crashed ();
+}
+
+void _gtu_crash_guard_enable (void) {
+  struct sigaction action;
+  unsigned i;
+
+  if (enabled)
+    return;
+
+  memset (&action, 0, sizeof (struct sigaction));
+  action.sa_sigaction = &crash_handler;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset (&action.sa_mask);
+
+  for (i = 0; i < G_N_ELEMENTS (crash_signals); i++)
+    g_assert (sigaction (crash_signals[i], &action, NULL) == 0);
+
+  enabled = true;
+}
+
+void _gtu_crash_guard_thread (void) {
+  CrashGuard* guard;
+  stack_t alt_stack;
+
+  if (!enabled || g_private_get (&thread_guard) != NULL)
+    return;
+
+  guard = g_new0 (CrashGuard, 1);
+  guard->alt_stack = g_malloc (ALT_STACK_SIZE);
+
+  memset (&alt_stack, 0, sizeof (stack_t));
+  alt_stack.ss_sp = guard->alt_stack;
+  alt_stack.ss_size = ALT_STACK_SIZE;
+  g_assert (sigaltstack (&alt_stack, NULL) == 0);
+
+  g_private_set (&thread_guard, guard);
+}
+
+char* _gtu_crash_guard_report (void) {
+  CrashGuard* guard = g_private_get (&thread_guard);
+  unsigned i;
+
+  g_assert (guard != NULL && guard->crashing);
+
+  for (i = 0; i < guard->n_frames; i++) {
+    const CrashFrame* frame = &guard->frames[i];
+
+    if (frame->name[0] != '\0')
+      gtu_log_diagnostic ("#%-2u 0x%016" G_GINT64_MODIFIER "x in %s+0x%"
+                          G_GINT64_MODIFIER "x",
+                          i, (guint64) frame->ip, frame->name,
+                          (guint64) frame->offset);
+    else
+      gtu_log_diagnostic ("#%-2u 0x%016" G_GINT64_MODIFIER "x in ??",
+                          i, (guint64) frame->ip);
+  }
+
+  guard->crashing = false;
+
+  return g_strdup_printf ("%s at address %p",
+                          g_strsignal (guard->signo), guard->address);
+}
@@ -3,45 +3,361 @@
 
 void _gtu_expected_message_dispose (GtuExpectedMessage* expected) {
   if (expected->domain) {
+    gtu_log_g_remove_interest (expected->domain, expected->flags);
     g_free (expected->domain);
     expected->domain = NULL;
   }
 
   if (expected->regex) {
-    g_regex_unref (expected->regex);
+    _gtu_cached_regex_release (expected->regex);
     expected->regex = NULL;
   }
 
+  if (expected->text.pattern) {
+    g_free (expected->text.pattern);
+    expected->text.pattern = NULL;
+  }
+
+  if (expected->field.key) {
+    g_free (expected->field.key);
+    expected->field.key = NULL;
+  }
+
+  if (expected->field.value) {
+    g_free (expected->field.value);
+    expected->field.value = NULL;
+  }
+
   expected->match_count.s = 0;
   expected->flags = 0;
 }
 
+void _gtu_expect_bucket_free (GtuExpectBucket* bucket) {
+  g_array_free (bucket->handles, true);
+  g_slice_free (GtuExpectBucket, bucket);
+}
+
+/* the caller fills in what to match against */
+static GtuExpectedMessage* expect_new (GtuTestCase* self,
+                                       const char* domain,
+                                       GLogLevelFlags level,
+                                       GtuExpectHandle* out_handle)
+{
+  GtuTestCasePrivate* priv = PRIVATE (self);
+  GtuExpectations* expectations = priv->expectations;
+  GtuExpectedMessage* msg;
+  GtuExpectBucket* bucket;
+
+  if (expectations == NULL) {
+    expectations = g_slice_new (GtuExpectations);
+
+    expectations->messages = g_array_new (false, true,
+                                          sizeof (GtuExpectedMessage));
+    g_array_set_clear_func (expectations->messages,
+                            (GDestroyNotify) &_gtu_expected_message_dispose);
+
+    expectations->index = g_hash_table_new_full (
+      &g_str_hash, &g_str_equal,
+      NULL, (GDestroyNotify) &_gtu_expect_bucket_free
+    );
+
+    priv->expectations = expectations;
+  }
+
+  *out_handle = expectations->messages->len;
+
+  g_array_set_size (expectations->messages, *out_handle + 1);
+  msg = &g_array_index (expectations->messages, GtuExpectedMessage,
+                        *out_handle);
+
+  msg->domain = g_strdup (domain);
+  msg->flags = level;
+
+  bucket = g_hash_table_lookup (expectations->index, domain);
+
+  if (bucket == NULL) {
+    bucket = g_slice_new (GtuExpectBucket);
+    bucket->levels = 0;
+    bucket->handles = g_array_new (false, false, sizeof (GtuExpectHandle));
+
+    g_hash_table_insert (expectations->index,
+                         (char*) g_intern_string (domain),
+                         bucket);
+  }
+
+  bucket->levels |= level;
+  g_array_append_val (bucket->handles, *out_handle);
+
+  /* make sure the message isn't thrown away before we get to count it */
+  gtu_log_g_add_interest (domain, level);
+
+  return msg;
+}
+
 GtuExpectHandle gtu_test_case_expect_message (GtuTestCase* self,
                                               const char* domain,
                                               GLogLevelFlags level,
                                               GRegex* regex)
 {
-  GtuTestCasePrivate* priv;
+  GtuExpectHandle ret;
+
+  g_return_val_if_fail (GTU_IS_TEST_CASE (self),              -1);
+  g_return_val_if_fail (domain != NULL && domain[0] != '\0',  -1);
+  g_return_val_if_fail (strcmp (GTU_LOG_DOMAIN, domain) != 0, -1);
+
+  expect_new (self, domain, level, &ret)->regex =
+    _gtu_cached_regex_adopt (regex);
+
+  return ret;
+}
+
+GtuExpectHandle gtu_test_case_expect_pattern (GtuTestCase* self,
+                                              const char* domain,
+                                              GLogLevelFlags level,
+                                              const char* pattern,
+                                              GtuPatternKind kind)
+{
   GtuExpectHandle ret;
   GtuExpectedMessage* msg;
+  GtuCachedRegex* regex = NULL;
 
   g_return_val_if_fail (GTU_IS_TEST_CASE (self),              -1);
   g_return_val_if_fail (domain != NULL && domain[0] != '\0',  -1);
   g_return_val_if_fail (strcmp (GTU_LOG_DOMAIN, domain) != 0, -1);
+  g_return_val_if_fail (pattern != NULL,                      -1);
 
-  priv = PRIVATE (self);
-  ret = priv->expected_msgs->len;
+  switch (kind) {
+    case GTU_PATTERN_KIND_LITERAL:
+    case GTU_PATTERN_KIND_GLOB:
+      break;
 
-  g_array_set_size (priv->expected_msgs, ret + 1);
-  msg = &g_array_index (priv->expected_msgs, GtuExpectedMessage, ret);
+    case GTU_PATTERN_KIND_REGEX: {
+      GError* error = NULL;
 
-  msg->domain = g_strdup (domain);
-  msg->regex = regex;
-  msg->flags = level;
+      regex = _gtu_cached_regex_get (pattern, 0, 0, &error);
+      if (regex == NULL) {
+        g_critical ("%s: invalid regex '%s': %s",
+                    G_STRFUNC, pattern, error->message);
+        g_error_free (error);
+        return -1;
+      }
+      break;
+    }
+
+    default:
+      g_return_val_if_reached (-1);
+  }
+
+  msg = expect_new (self, domain, level, &ret);
+
+  if (regex != NULL) {
+    msg->regex = regex;
+  } else {
+    msg->text.pattern = g_strdup (pattern);
+    msg->text.kind = kind;
+  }
+
+  return ret;
+}
+
+GtuExpectHandle gtu_test_case_expect_field (GtuTestCase* self,
+                                            const char* domain,
+                                            GLogLevelFlags level,
+                                            const char* key,
+                                            const char* value)
+{
+  GtuExpectHandle ret;
+  GtuExpectedMessage* msg;
+
+  g_return_val_if_fail (GTU_IS_TEST_CASE (self),              -1);
+  g_return_val_if_fail (domain != NULL && domain[0] != '\0',  -1);
+  g_return_val_if_fail (strcmp (GTU_LOG_DOMAIN, domain) != 0, -1);
+  g_return_val_if_fail (key != NULL && value != NULL,         -1);
+
+  msg = expect_new (self, domain, level, &ret);
+  msg->field.key = g_strdup (key);
+  msg->field.match = GTU_FIELD_MATCH_EXACT;
+  msg->field.value = g_strdup (value);
+  msg->field.length = strlen (value);
 
   return ret;
 }
 
+GtuExpectHandle gtu_test_case_expect_field_prefix (GtuTestCase* self,
+                                                   const char* domain,
+                                                   GLogLevelFlags level,
+                                                   const char* key,
+                                                   const char* prefix)
+{
+  GtuExpectHandle ret;
+  GtuExpectedMessage* msg;
+
+  g_return_val_if_fail (GTU_IS_TEST_CASE (self),              -1);
+  g_return_val_if_fail (domain != NULL && domain[0] != '\0',  -1);
+  g_return_val_if_fail (strcmp (GTU_LOG_DOMAIN, domain) != 0, -1);
+  g_return_val_if_fail (key != NULL && prefix != NULL,        -1);
+
+  msg = expect_new (self, domain, level, &ret);
+  msg->field.key = g_strdup (key);
+  msg->field.match = GTU_FIELD_MATCH_PREFIX;
+  msg->field.value = g_strdup (prefix);
+  msg->field.length = strlen (prefix);
+
+  return ret;
+}
+
+GtuExpectHandle gtu_test_case_expect_field_range (GtuTestCase* self,
+                                                  const char* domain,
+                                                  GLogLevelFlags level,
+                                                  const char* key,
+                                                  gint64 min,
+                                                  gint64 max)
+{
+  GtuExpectHandle ret;
+  GtuExpectedMessage* msg;
+
+  g_return_val_if_fail (GTU_IS_TEST_CASE (self),              -1);
+  g_return_val_if_fail (domain != NULL && domain[0] != '\0',  -1);
+  g_return_val_if_fail (strcmp (GTU_LOG_DOMAIN, domain) != 0, -1);
+  g_return_val_if_fail (key != NULL && min <= max,            -1);
+
+  msg = expect_new (self, domain, level, &ret);
+  msg->field.key = g_strdup (key);
+  msg->field.match = GTU_FIELD_MATCH_RANGE;
+  msg->field.min = min;
+  msg->field.max = max;
+
+  return ret;
+}
+
+/* skips one UTF-8 character without trusting it to be well formed */
+static const char* next_char (const char* string) {
+  do
+    string++;
+  while (((unsigned char) *string & 0xc0) == 0x80);
+
+  return string;
+}
+
+/* Matches the whole of `string' against a glob as understood by GPatternSpec:
+   '*' matches any run of characters and '?' any one character. When a '*'
+   can't be stretched over what follows it any other way, we only ever need to
+   retry from the most recent one, so this doesn't backtrack any further. */
+static bool match_glob (const char* pattern, const char* string) {
+  const char* star = NULL;
+  const char* resume = NULL;
+
+  while (*string != '\0') {
+    if (*pattern == '*') {
+      star = ++pattern;
+      resume = string;
+
+    } else if (*pattern == '?') {
+      pattern++;
+      string = next_char (string);
+
+    } else if (*pattern == *string) {
+      pattern++;
+      string++;
+
+    } else if (star != NULL) {
+      pattern = star;
+      string = resume = next_char (resume);
+
+    } else {
+      return false;
+    }
+  }
+
+  while (*pattern == '*')
+    pattern++;
+
+  return *pattern == '\0';
+}
+
+static bool match_fields (const GtuExpectedMessage* expected,
+                          const GLogField* fields,
+                          size_t n_fields)
+{
+#if GLIB_CHECK_VERSION (2, 50, 0)
+  size_t i;
+
+  for (i = 0; i < n_fields; i++) {
+    const char* value = fields[i].value;
+    size_t length;
+
+    if (strcmp (fields[i].key, expected->field.key) != 0)
+      continue;
+
+    length = fields[i].length < 0 ? strlen (value) : (size_t) fields[i].length;
+
+    switch (expected->field.match) {
+      case GTU_FIELD_MATCH_EXACT:
+        return length == expected->field.length &&
+               memcmp (value, expected->field.value, length) == 0;
+
+      case GTU_FIELD_MATCH_PREFIX:
+        return length >= expected->field.length &&
+               memcmp (value, expected->field.value,
+                       expected->field.length) == 0;
+
+      case GTU_FIELD_MATCH_RANGE: {
+        char* endptr;
+        gint64 number;
+
+        /* g_ascii_strtoll() needs a terminator */
+        if (fields[i].length >= 0)
+          return false;
+
+        number = g_ascii_strtoll (value, &endptr, 10);
+
+        return endptr != value && *endptr == '\0' &&
+               number >= expected->field.min &&
+               number <= expected->field.max;
+      }
+
+      default:
+        g_assert_not_reached ();
+    }
+  }
+#else
+  (void) expected;
+  (void) fields;
+  (void) n_fields;
+#endif
+
+  return false;
+}
+
+bool _gtu_expected_message_match (const GtuExpectedMessage* expected,
+                                  const GtuLogGMessage* message)
+{
+  const GtuCachedRegex* regex = expected->regex;
+
+  /* a structured message without a MESSAGE field only has fields to match */
+  if (message->body == NULL)
+    return regex == NULL && expected->text.pattern == NULL &&
+           match_fields (expected, message->fields, message->n_fields);
+
+  if (regex != NULL) {
+    if (regex->literal != NULL && strstr (message->body, regex->literal) == NULL)
+      return false;
+
+    return g_regex_match (regex->regex, message->body,
+                          G_REGEX_MATCH_NOTEMPTY,
+                          NULL);
+  }
+
+  if (expected->text.pattern != NULL) {
+    if (expected->text.kind == GTU_PATTERN_KIND_LITERAL)
+      return strstr (message->body, expected->text.pattern) != NULL;
+
+    return match_glob (expected->text.pattern, message->body);
+  }
+
+  return match_fields (expected, message->fields, message->n_fields);
+}
+
 bool gtu_test_case_expect_check (GtuTestCase* self, GtuExpectHandle handle) {
   GtuTestCasePrivate* priv;
   GtuExpectedMessage* msg;
@@ -49,8 +365,10 @@ bool gtu_test_case_expect_check (GtuTestCase* self, GtuExpectHandle handle) {
   g_return_val_if_fail (GTU_IS_TEST_CASE (self), false);
   priv = PRIVATE (self);
 
-  g_return_val_if_fail (handle < priv->expected_msgs->len, false);
-  msg = &g_array_index (priv->expected_msgs, GtuExpectedMessage, handle);
+  g_return_val_if_fail (priv->expectations != NULL &&
+                          handle < priv->expectations->messages->len, false);
+  msg = &g_array_index (priv->expectations->messages, GtuExpectedMessage,
+                        handle);
 
   return msg->match_count.u > 0;
 }
@@ -64,8 +382,10 @@ unsigned gtu_test_case_expect_count (GtuTestCase* self,
   g_return_val_if_fail (GTU_IS_TEST_CASE (self), false);
   priv = PRIVATE (self);
 
-  g_return_val_if_fail (handle < priv->expected_msgs->len, false);
-  msg = &g_array_index (priv->expected_msgs, GtuExpectedMessage, handle);
+  g_return_val_if_fail (priv->expectations != NULL &&
+                          handle < priv->expectations->messages->len, false);
+  msg = &g_array_index (priv->expectations->messages, GtuExpectedMessage,
+                        handle);
 
   return g_atomic_int_and (&msg->match_count.u, 0);
 }
@@ -4,19 +4,54 @@
 #include <setjmp.h>
 #include "gtu-priv.h"
 
+/* shared by the thread running a test and any it starts with
+   gtu_thread_new() */
 typedef struct {
   uint32_t magic;
-  jmp_buf caller_context;
+  GtuTestCase* owner;
   char* message;
   GtuTestResult result;
+  GtuLogTestDetails* details;
+  bool finished;
+  volatile int ref_count;
 } TestRunContext;
 
+/* returns NULL if the calling thread isn't running a test */
 G_GNUC_INTERNAL TestRunContext* _gtu_get_tr_context (void);
 
-G_GNUC_INTERNAL GtuTestResult _gtu_test_case_exec_inner (GtuTestCaseFunc func,
+/* Fails or skips the test, taking `message', unless another thread has
+   already decided its outcome. file, line and function may be NULL. */
+G_GNUC_INTERNAL void _gtu_tr_context_set_outcome (TestRunContext* tr_context,
+                                                  GtuTestResult result,
+                                                  char* message,
+                                                  const char* file,
+                                                  const char* line,
+                                                  const char* function);
+
+/* Runs `func' as part of `owner'. details may be NULL; if not, the location
+   of a failed assert or skip is written to it. */
+G_GNUC_INTERNAL GtuTestResult _gtu_test_case_exec_inner (GtuTestCase* owner,
+                                                         GtuTestCaseFunc func,
                                                          void* func_target,
-                                                         char** message);
+                                                         char** message,
+                                                         GtuLogTestDetails* details);
 
 G_GNUC_INTERNAL void _gtu_test_preempt () G_GNUC_NORETURN;
 
+/* Called from the crash handler; backs out of the test, which then fails with
+   the crash guard's report. */
+G_GNUC_INTERNAL void _gtu_test_preempt_crashed (void) G_GNUC_NORETURN;
+
+/* Installs handlers for SIGSEGV, SIGBUS and SIGFPE which turn a crash in test
+   code into a test failure. */
+G_GNUC_INTERNAL void _gtu_crash_guard_enable (void);
+
+/* Sets up an alternate signal stack for the calling thread, if the crash guard
+   is enabled and it doesn't already have one. */
+G_GNUC_INTERNAL void _gtu_crash_guard_thread (void);
+
+/* Logs the backtrace of the crash that preempted the calling thread and
+   returns a description of it. */
+G_GNUC_INTERNAL char* _gtu_crash_guard_report (void);
+
 #endif
@@ -4,16 +4,25 @@
 #include "gtu-priv.h"
 #include "priv-setjmp.h"
 #include "priv-complex.h"
+#include "log/log-glib.h"
 
+/* Most tests never expect a message, so a test case only gets one of these
+   with its first expectation. */
 typedef struct {
-  GtuTestCaseFunc func;
-  void*           func_target;
-  GDestroyNotify  func_target_destroy;
-  GArray*         expected_msgs; /* array of ExpectedMessage */
-  GtuTestResult   result;
-  bool            has_disposed;  /* FALSE if we're valid, TRUE if we've been
-                                    executed and subsequently freed all
-                                    internally held resources. */
+  GArray*     messages; /* array of ExpectedMessage */
+  GHashTable* index;    /* interned domain -> ExpectBucket */
+} GtuExpectations;
+
+typedef struct {
+  GtuTestCaseFunc  func;
+  void*            func_target;
+  GDestroyNotify   func_target_destroy;
+  GtuExpectations* expectations;
+  GtuTestResult    result;
+  bool             parallel_safe;
+  bool             has_disposed;  /* FALSE if we're valid, TRUE if we've been
+                                     executed and subsequently freed all
+                                     internally held resources. */
 } GtuTestCasePrivate;
 
 #define PRIVATE(obj) \
@@ -21,19 +30,79 @@ typedef struct {
 
 G_GNUC_INTERNAL void _gtu_test_case_dispose (GtuTestCase* self);
 
+typedef enum {
+  GTU_FIELD_MATCH_EXACT,
+  GTU_FIELD_MATCH_PREFIX,
+  GTU_FIELD_MATCH_RANGE
+} GtuFieldMatch;
+
+/* A regex shared between every expectation using the same pattern and flags.
+   A body which doesn't contain `literal', some text every match of `regex'
+   must contain, is rejected without running the regex. */
 typedef struct {
-  char*          domain;
-  GRegex*        regex;
+  GRegex*  regex;
+  char*    literal;
+
+  /*< private >*/
+  char*    key;
+  unsigned ref_count; /* protected by the cache's lock */
+} GtuCachedRegex;
+
+/* compiles `pattern', or finds it already compiled */
+G_GNUC_INTERNAL GtuCachedRegex*
+_gtu_cached_regex_get (const char* pattern,
+                       GRegexCompileFlags compile_flags,
+                       GRegexMatchFlags match_flags,
+                       GError** error);
+
+/* takes `regex', swapping it for the cached copy if there is one */
+G_GNUC_INTERNAL GtuCachedRegex* _gtu_cached_regex_adopt (GRegex* regex);
+
+G_GNUC_INTERNAL void _gtu_cached_regex_release (GtuCachedRegex* cached);
+
+/* An expectation matches the message body against `regex' or `text', or if
+   neither is set, the structured field named `field.key'. */
+typedef struct {
+  char*           domain;
+  GtuCachedRegex* regex;
+
+  struct {
+    char*          pattern;
+    GtuPatternKind kind;    /* LITERAL or GLOB */
+  } text;
+
+  struct {
+    char*         key;
+    GtuFieldMatch match;
+    char*         value;    /* for EXACT and PREFIX */
+    size_t        length;
+    gint64        min, max; /* for RANGE */
+  } field;
 
   union {
     volatile int s;
     volatile unsigned u;
   } match_count;
 
-  GLogLevelFlags flags;
+  GLogLevelFlags  flags;
 } GtuExpectedMessage;
 
+/* Expectations in a test case's index are grouped by domain. `levels' is the
+   union of their flags, so most messages can be turned away before we look at
+   any of them. */
+typedef struct {
+  GLogLevelFlags levels;
+  GArray*        handles; /* array of GtuExpectHandle, in the order added */
+} GtuExpectBucket;
+
 G_GNUC_INTERNAL void
 _gtu_expected_message_dispose (GtuExpectedMessage* message);
 
+G_GNUC_INTERNAL void _gtu_expect_bucket_free (GtuExpectBucket* bucket);
+
+/* doesn't check the domain or level */
+G_GNUC_INTERNAL bool
+_gtu_expected_message_match (const GtuExpectedMessage* expected,
+                             const GtuLogGMessage* message);
+
 #endif
@@ -0,0 +1,274 @@
+/* A process-wide cache of the regexes expectations match against, so that a
+   suite full of test cases expecting the same few messages compiles and keeps
+   each pattern once. */
+
+#include <string.h>
+#include "priv.h"
+
+/* Finds the longest run of plain characters that any match of `pattern' has
+   to contain, or returns NULL if there isn't one we can be sure of. This only
+   needs to be conservative, not clever, so anything unusual gives up. */
+static char* required_literal (const char* pattern, GRegexCompileFlags flags) {
+  GString* run;
+  char* best = NULL;
+  size_t best_length = 0;
+  int depth = 0;
+  const char* p;
+
+  /* case folding and ignored whitespace would need a lot more care */
+  if (flags & (G_REGEX_CASELESS | G_REGEX_EXTENDED))
+    return NULL;
+
+  /* alternation can make anything optional; (? can change the above */
+  if (strchr (pattern, '|') != NULL || strstr (pattern, "(?") != NULL)
+    return NULL;
+
+  run = g_string_new (NULL);
+
+  for (p = pattern; ; p++) {
+    bool literal = false;
+    char c = *p;
+
+    switch (c) {
+      case '\\':
+        if (p[1] == '\0')
+          goto give_up;
+
+        c = *++p;
+
+        /* escaped punctuation is literal, and these escapes match some
+           character or position without consuming anything after them. Any
+           others (backreferences, octal, \x, \p, \Q...) we don't try to
+           understand. */
+        if (!g_ascii_isalnum (c))
+          literal = true;
+        else if (strchr ("dDwWsSbBAZzGhHvVRXntrfea", c) == NULL)
+          goto give_up;
+        break;
+
+      case '[':
+        /* a ']' straight after the opening bracket is part of the class */
+        if (*++p == '^')
+          p++;
+        if (*p == ']')
+          p++;
+
+        for (; *p != ']'; p++) {
+          if (*p == '\0')
+            goto give_up;
+          if (*p == '\\' && *++p == '\0')
+            goto give_up;
+
+          /* [:alpha:], [=a=] and [.a.] have their own closing bracket */
+          if (*p == '[' && p[1] != '\0' && strchr (":=.", p[1]) != NULL) {
+            char terminator[3] = { p[1], ']', '\0' };
+
+            p = strstr (p + 2, terminator);
+            if (p == NULL)
+              goto give_up;
+            p++;
+          }
+        }
+        break;
+
+      case '(':
+        depth++;
+        break;
+
+      case ')':
+        depth--;
+        break;
+
+      case '?':
+      case '*':
+      case '{':
+        /* the previous character is optional, and may be several bytes */
+        if (run->len > 0) {
+          const char* prev = g_utf8_find_prev_char (run->str,
+                                                    run->str + run->len);
+
+          g_string_truncate (run, prev != NULL ? (gsize) (prev - run->str) : 0);
+        }
+
+        if (c == '{') {
+          p = strchr (p, '}');
+          if (p == NULL)
+            goto give_up;
+        }
+        break;
+
+      case '+':
+      case '.':
+      case '^':
+      case '$':
+      case '\0':
+        break;
+
+      default:
+        literal = true;
+    }
+
+    if (literal && depth == 0) {
+      g_string_append_c (run, c);
+      continue;
+    }
+
+    if (literal)
+      continue;
+
+    if (run->len > best_length) {
+      g_free (best);
+      best = g_strndup (run->str, run->len);
+      best_length = run->len;
+    }
+
+    g_string_truncate (run, 0);
+
+    if (c == '\0')
+      break;
+  }
+
+  g_string_free (run, true);
+  return best;
+
+give_up:
+  g_string_free (run, true);
+  g_free (best);
+  return NULL;
+}
+
+/* Recompiles `regex' with G_REGEX_OPTIMIZE, taking ownership of it. That's
+   only worth doing before GLib moved to PCRE2, which optimises everything
+   anyway. */
+static GRegex* optimise_regex (GRegex* regex) {
+  GRegex* optimised;
+  GRegexCompileFlags flags = g_regex_get_compile_flags (regex);
+
+  if ((flags & G_REGEX_OPTIMIZE) || glib_check_version (2, 74, 0) == NULL)
+    return regex;
+
+  optimised = g_regex_new (g_regex_get_pattern (regex),
+                           flags | G_REGEX_OPTIMIZE,
+                           g_regex_get_match_flags (regex),
+                           NULL);
+
+  if (optimised == NULL)
+    return regex;
+
+  g_regex_unref (regex);
+  return optimised;
+}
+
+/* Entries are keyed by the flags and pattern they were compiled from, and
+   removed again once the last expectation using them lets go. */
+G_LOCK_DEFINE_STATIC (regex_cache);
+static GHashTable* regex_cache = NULL;
+
+static char* cache_key (const char* pattern,
+                        GRegexCompileFlags compile_flags,
+                        GRegexMatchFlags match_flags)
+{
+  /* whether we optimised the regex ourselves doesn't change what it matches */
+  compile_flags &= ~G_REGEX_OPTIMIZE;
+
+  return g_strdup_printf ("%x:%x:%s", (unsigned) compile_flags,
+                          (unsigned) match_flags, pattern);
+}
+
+/* must be called with the lock held; takes `regex' and `key' */
+static GtuCachedRegex* cache_insert (char* key, GRegex* regex) {
+  GtuCachedRegex* cached = g_slice_new (GtuCachedRegex);
+
+  cached->regex = optimise_regex (regex);
+  cached->literal = required_literal (g_regex_get_pattern (cached->regex),
+                                      g_regex_get_compile_flags (cached->regex));
+  cached->key = key;
+  cached->ref_count = 1;
+
+  if (regex_cache == NULL)
+    regex_cache = g_hash_table_new (&g_str_hash, &g_str_equal);
+
+  g_hash_table_insert (regex_cache, cached->key, cached);
+
+  return cached;
+}
+
+GtuCachedRegex* _gtu_cached_regex_get (const char* pattern,
+                                       GRegexCompileFlags compile_flags,
+                                       GRegexMatchFlags match_flags,
+                                       GError** error)
+{
+  GtuCachedRegex* cached;
+  GRegex* regex;
+  char* key = cache_key (pattern, compile_flags, match_flags);
+
+  G_LOCK (regex_cache);
+
+  if (regex_cache != NULL &&
+      (cached = g_hash_table_lookup (regex_cache, key)) != NULL)
+  {
+    cached->ref_count++;
+    G_UNLOCK (regex_cache);
+
+    g_free (key);
+    return cached;
+  }
+
+  regex = g_regex_new (pattern, compile_flags, match_flags, error);
+  if (regex == NULL) {
+    G_UNLOCK (regex_cache);
+
+    g_free (key);
+    return NULL;
+  }
+
+  cached = cache_insert (key, regex);
+
+  G_UNLOCK (regex_cache);
+
+  return cached;
+}
+
+GtuCachedRegex* _gtu_cached_regex_adopt (GRegex* regex) {
+  GtuCachedRegex* cached;
+  char* key = cache_key (g_regex_get_pattern (regex),
+                         g_regex_get_compile_flags (regex),
+                         g_regex_get_match_flags (regex));
+
+  G_LOCK (regex_cache);
+
+  if (regex_cache != NULL &&
+      (cached = g_hash_table_lookup (regex_cache, key)) != NULL)
+  {
+    cached->ref_count++;
+    G_UNLOCK (regex_cache);
+
+    g_free (key);
+    g_regex_unref (regex);
+    return cached;
+  }
+
+  cached = cache_insert (key, regex);
+
+  G_UNLOCK (regex_cache);
+
+  return cached;
+}
+
+void _gtu_cached_regex_release (GtuCachedRegex* cached) {
+  G_LOCK (regex_cache);
+
+  if (--cached->ref_count > 0) {
+    G_UNLOCK (regex_cache);
+    return;
+  }
+
+  g_hash_table_remove (regex_cache, cached->key);
+
+  G_UNLOCK (regex_cache);
+
+  g_regex_unref (cached->regex);
+  g_free (cached->literal);
+  g_free (cached->key);
+  g_slice_free (GtuCachedRegex, cached);
+}
@@ -5,32 +5,43 @@
 
 static GtuLogAction log_hook (GtuLogGMessage* message, void* user_data) {
   GtuTestCase* self;
+  TestRunContext* tr_context;
 
   g_assert (GTU_IS_TEST_CASE (user_data));
   self = GTU_TEST_CASE (user_data);
 
   g_assert (message != NULL);
 
+  tr_context = _gtu_get_tr_context ();
+
+  /* Tests running alongside each other all have a hook on the stack; leave
+     messages from a thread running some other test to that test's hook.
+     Threads not running any test are fair game for expectations. */
+  if (tr_context != NULL && tr_context->owner != self)
+    return GTU_LOG_ACTION_CONTINUE;
+
   /* Note: we assume the user does not/cannot add an expectation for a GTU
    *       logging domain, so any such check is omitted here. */
-  if (message->domain != NULL) {
+  if (message->domain != NULL && PRIVATE (self)->expectations != NULL) {
     unsigned i;
-    GtuTestCasePrivate* priv = PRIVATE (self);
-
-    for (i = 0; i < priv->expected_msgs->len; i++) {
-      GtuExpectedMessage* expect =
-        &g_array_index (priv->expected_msgs, GtuExpectedMessage, i);
-
-      if (strcmp (expect->domain, message->domain) != 0)
-        continue;
+    GtuExpectations* expectations = PRIVATE (self)->expectations;
+    GtuExpectBucket* bucket = g_hash_table_lookup (expectations->index,
+                                                   message->domain);
+
+    for (i = 0;
+         bucket != NULL && (message->flags & bucket->levels) != 0 &&
+           i < bucket->handles->len;
+         i++)
+    {
+      GtuExpectedMessage* expect = &g_array_index (
+        expectations->messages, GtuExpectedMessage,
+        g_array_index (bucket->handles, GtuExpectHandle, i)
+      );
 
       if ((message->flags & expect->flags) == 0)
         continue;
 
-      if (g_regex_match (expect->regex, message->body,
-                         G_REGEX_MATCH_NOTEMPTY,
-                         NULL))
-      {
+      if (_gtu_expected_message_match (expect, message)) {
         g_atomic_int_inc (&expect->match_count.s);
         return _gtu_should_log (G_LOG_LEVEL_INFO) ?
           GTU_LOG_ACTION_SUPPRESS :
@@ -44,14 +55,17 @@ static GtuLogAction log_hook (GtuLogGMessage* message, void* user_data) {
 
   if (message->flags & (G_LOG_LEVEL_CRITICAL | G_LOG_LEVEL_WARNING)) {
     GString* fail_message;
-    TestRunContext* tr_context;
+
+    /* we've no way of backing out of a thread we didn't start */
+    if (tr_context == NULL)
+      return GTU_LOG_ACTION_CONTINUE;
 
     fail_message = g_string_new ("Unexpected message: ");
     gtu_log_g_format_message_append (fail_message, message);
 
-    tr_context = _gtu_get_tr_context ();
-    tr_context->message = g_string_free (fail_message, false);
-    tr_context->result = GTU_TEST_RESULT_FAIL;
+    _gtu_tr_context_set_outcome (tr_context, GTU_TEST_RESULT_FAIL,
+                                 g_string_free (fail_message, false),
+                                 NULL, NULL, NULL);
 
     return GTU_LOG_ACTION_ABORT;
   }
@@ -59,7 +73,10 @@ static GtuLogAction log_hook (GtuLogGMessage* message, void* user_data) {
   return GTU_LOG_ACTION_CONTINUE;
 }
 
-GtuTestResult _gtu_test_case_run (GtuTestCase* self, char** out_message) {
+GtuTestResult _gtu_test_case_run (GtuTestCase* self,
+                                  char** out_message,
+                                  GtuLogTestDetails* details)
+{
   char* message = NULL;
   const char* path;
   GtuTestCasePrivate* priv;
@@ -77,19 +94,26 @@ GtuTestResult _gtu_test_case_run (GtuTestCase* self, char** out_message) {
             path,
             gtu_log_lookup_color (GTU_LOG_COLOR_DISABLE));
 
+    if (details != NULL)
+      gtu_log_test_details_begin (details);
+
     if (GTU_IS_COMPLEX_CASE (self)) {
       priv->result = _gtu_complex_case_run (GTU_COMPLEX_CASE (self), &message);
     } else {
-      priv->result =
-        _gtu_test_case_exec_inner (priv->func, priv->func_target, &message);
+      priv->result = _gtu_test_case_exec_inner (self,
+                                                priv->func, priv->func_target,
+                                                &message, details);
     }
 
+    if (details != NULL)
+      gtu_log_test_details_end (details);
+
     g_info ("%s<<< %s%s",
             gtu_log_lookup_color (GTU_LOG_COLOR_FLAG_BOLD),
             path,
             gtu_log_lookup_color (GTU_LOG_COLOR_DISABLE));
 
-    gtu_log_hooks_pop (&log_hook);
+    gtu_log_hooks_pop (&log_hook, self);
 
     _gtu_test_case_dispose (self);
   }
@@ -1,37 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <string.h>
 #include "log/logio.h"
+#include "log/log-hooks.h"
 #include "test-case/priv-setjmp.h"
 
 /* lazy sanity checking */
 static const uint32_t TR_MAGIC = 0x7357CA5E;
 
-static void _gtu_tr_context_check (const TestRunContext* tr_context) {
+/* Every thread running test code has a ThreadContext of its own, which is
+   where it jumps back to once the test is over as far as it's concerned. The
+   thread running the test and any it started with gtu_thread_new() share a
+   TestRunContext. */
+typedef struct {
+  sigjmp_buf      caller_context;
+  TestRunContext* tr_context;
+} ThreadContext;
+
+static GPrivate current_thread = G_PRIVATE_INIT (NULL);
+
+/* protects the outcome of every TestRunContext; it's only taken when a test
+   is on its way out, so one lock will do for all of them */
+G_LOCK_DEFINE_STATIC (outcome);
+
+typedef struct {
+  GThreadFunc     func;
+  void*           data;
+  TestRunContext* tr_context;
+  GtuLogCapture*  capture;
+} ThreadStart;
+
+static ThreadContext* current_context (void) {
+  ThreadContext* context = g_private_get (&current_thread);
+
   g_assert (gtu_has_initialized ());
-  g_assert (tr_context != NULL);
-  g_assert (tr_context->magic == TR_MAGIC);
-  g_assert (tr_context->message == NULL);
-}
+  g_assert (context != NULL);
+  g_assert (context->tr_context->magic == TR_MAGIC);
 
-static TestRunContext* _current_tr_context = NULL;
+  return context;
+}
 
-#define CURRENT_CONTEXT_CHECK() _gtu_tr_context_check (_current_tr_context)
-#define CURRENT_CONTEXT (CURRENT_CONTEXT_CHECK (), _current_tr_context)
+/* what sigsetjmp() returns when we're back from a test */
+enum {
+  PREEMPTED = 1,
+  PREEMPTED_BY_CRASH
+};
 
-#define PREEMPT_TEST() G_STMT_START {               \
-  longjmp (_current_tr_context->caller_context, 1); \
-  g_assert_not_reached ();                          \
+#define PREEMPT_TEST(context) G_STMT_START {         \
+  siglongjmp ((context)->caller_context, PREEMPTED); \
+  g_assert_not_reached ();                           \
 } G_STMT_END
 
+static TestRunContext* tr_context_ref (TestRunContext* tr_context) {
+  g_atomic_int_inc (&tr_context->ref_count);
+  return tr_context;
+}
+
+static void tr_context_unref (TestRunContext* tr_context) {
+  if (!g_atomic_int_dec_and_test (&tr_context->ref_count))
+    return;
+
+  g_free (tr_context->message);
+
+  memset (tr_context, 0, sizeof (TestRunContext));
+  free (tr_context);
+}
+
 
 TestRunContext* _gtu_get_tr_context (void) {
-  return CURRENT_CONTEXT;
+  ThreadContext* context = g_private_get (&current_thread);
+
+  return context != NULL ? context->tr_context : NULL;
+}
+
+void _gtu_tr_context_set_outcome (TestRunContext* tr_context,
+                                  GtuTestResult result,
+                                  char* message,
+                                  const char* file,
+                                  const char* line,
+                                  const char* function)
+{
+  g_assert (tr_context->magic == TR_MAGIC);
+  g_assert (result == GTU_TEST_RESULT_FAIL || result == GTU_TEST_RESULT_SKIP);
+
+  G_LOCK (outcome);
+
+  /* another thread got there first, or the test has already finished */
+  if (tr_context->result != GTU_TEST_RESULT_PASS || tr_context->finished) {
+    G_UNLOCK (outcome);
+    g_free (message);
+    return;
+  }
+
+  tr_context->message = message;
+  tr_context->result = result;
+
+  /* the arguments are all string literals, so we can hold onto them */
+  if (tr_context->details != NULL && file != NULL) {
+    tr_context->details->file = file;
+    tr_context->details->line = line;
+    tr_context->details->function = function;
+  }
+
+  G_UNLOCK (outcome);
 }
 
 /* No asserts because anything log related will fail; we're in this function
    because we've blown the stack away, which can cause segfaults in GLib's
    printf implementation. */
 void _gtu_test_preempt () {
-  longjmp (_current_tr_context->caller_context, 1);
+  siglongjmp (((ThreadContext*) g_private_get (&current_thread))->caller_context,
+              PREEMPTED);
+}
+
+/* Likewise, and we're in a signal handler. */
+void _gtu_test_preempt_crashed (void) {
+  siglongjmp (((ThreadContext*) g_private_get (&current_thread))->caller_context,
+              PREEMPTED_BY_CRASH);
+}
+
+/* Ends the run because of a failure. A test whose results are reported later,
+   in order, by another thread leaves the bail out to be done then, and is
+   failed as usual in the meantime; this returns if that's the case. */
+static void bail_out (const char* message) {
+  GtuLogCapture* capture = gtu_log_capture_get_thread ();
+
+  if (capture == NULL) {
+    gtu_log_bail_out (false, "%s", message);
+    g_assert_not_reached ();
+  }
+
+  gtu_log_capture_bail_out (capture, message);
+}
+
+static void test_crashed (ThreadContext* context) {
+  char* message;
+
+  /* we might have crashed in a log hook */
+  gtu_log_hooks_abandon_reads ();
+
+  message = _gtu_crash_guard_report ();
+
+  if (!_gtu_keep_going)
+    bail_out (message);
+
+  _gtu_tr_context_set_outcome (context->tr_context, GTU_TEST_RESULT_FAIL,
+                               message, NULL, NULL, NULL);
 }
 
 void _gtu_assertion_message (const char* file,
@@ -40,7 +154,7 @@ void _gtu_assertion_message (const char* file,
                              const char* message)
 {
   char* location_message;
-  CURRENT_CONTEXT_CHECK ();
+  ThreadContext* context = current_context ();
 
   g_assert (file != NULL && line != NULL && function != NULL);
   if (message == NULL)
@@ -53,14 +167,13 @@ void _gtu_assertion_message (const char* file,
     g_printerr ("**\nERROR:%s\n", location_message);
     abort ();
   } else if (!_gtu_keep_going) {
-    gtu_log_bail_out (false, location_message);
-    g_assert_not_reached ();
+    bail_out (location_message);
   }
 
-  _current_tr_context->message = location_message;
-  _current_tr_context->result = GTU_TEST_RESULT_FAIL;
+  _gtu_tr_context_set_outcome (context->tr_context, GTU_TEST_RESULT_FAIL,
+                               location_message, file, line, function);
 
-  PREEMPT_TEST ();
+  PREEMPT_TEST (context);
 }
 
 void _gtu_skip_if_reached_message (const char* file,
@@ -68,41 +181,145 @@ void _gtu_skip_if_reached_message (const char* file,
                                    const char* function,
                                    const char* message)
 {
-  CURRENT_CONTEXT_CHECK ();
+  ThreadContext* context = current_context ();
+
   g_assert ((file != NULL && line != NULL && function != NULL) ||
             message != NULL);
 
-  _current_tr_context->message = message != NULL ?
-    g_strdup (message) :
-    g_strdup_printf ("Check failed at %s:%s:%s", file, line, function);
-
-  _current_tr_context->result = GTU_TEST_RESULT_SKIP;
+  _gtu_tr_context_set_outcome (
+    context->tr_context, GTU_TEST_RESULT_SKIP,
+    message != NULL ?
+      g_strdup (message) :
+      g_strdup_printf ("Check failed at %s:%s:%s", file, line, function),
+    file, line, function
+  );
 
-  PREEMPT_TEST ();
+  PREEMPT_TEST (context);
 }
 
-GtuTestResult _gtu_test_case_exec_inner (GtuTestCaseFunc func,
+GtuTestResult _gtu_test_case_exec_inner (GtuTestCase* owner,
+                                         GtuTestCaseFunc func,
                                          void* func_target,
-                                         char** message)
+                                         char** message,
+                                         GtuLogTestDetails* details)
 {
   GtuTestResult ret;
+  ThreadContext context;
+  TestRunContext* tr_context;
 
   g_assert (func != NULL && message != NULL);
-  g_assert (_current_tr_context == NULL);
+  g_assert (g_private_get (&current_thread) == NULL);
+
+  tr_context = calloc (1, sizeof (TestRunContext));
+  tr_context->magic = TR_MAGIC;
+  tr_context->owner = owner;
+  tr_context->result = GTU_TEST_RESULT_PASS;
+  tr_context->details = details;
+  tr_context->ref_count = 1;
+
+  context.tr_context = tr_context;
+  g_private_set (&current_thread, &context);
+  _gtu_crash_guard_thread ();
+
+  switch (sigsetjmp (context.caller_context, 0)) {
+    case 0:
+      func (func_target);
+      break;
+
+    case PREEMPTED_BY_CRASH:
+      test_crashed (&context);
+      break;
+  }
+
+  g_private_set (&current_thread, NULL);
+
+  /* stragglers mustn't touch `details' once we've returned */
+  G_LOCK (outcome);
+
+  *message = tr_context->message;
+  ret = tr_context->result;
+
+  tr_context->message = NULL;
+  tr_context->finished = true;
+
+  G_UNLOCK (outcome);
+
+  tr_context_unref (tr_context);
+
+  return ret;
+}
+
+static void* thread_start (void* data) {
+  ThreadStart* start = data;
+  ThreadContext context;
+  GThreadFunc func = start->func;
+  void* func_data = start->data;
+  void* volatile ret = NULL;
 
-  _current_tr_context = calloc (1, sizeof (TestRunContext));
-  _current_tr_context->magic = TR_MAGIC;
-  _current_tr_context->result = GTU_TEST_RESULT_PASS;
+  context.tr_context = start->tr_context;
 
-  if (!setjmp (_current_tr_context->caller_context))
-    func (func_target);
+  /* a test running alongside others has its diagnostics held back */
+  gtu_log_capture_set_thread (start->capture);
+  g_slice_free (ThreadStart, start);
 
-  *message = _current_tr_context->message;
-  ret = _current_tr_context->result;
+  g_private_set (&current_thread, &context);
+  _gtu_crash_guard_thread ();
 
-  memset (_current_tr_context, 0, sizeof (TestRunContext));
-  free (_current_tr_context);
-  _current_tr_context = NULL;
+  switch (sigsetjmp (context.caller_context, 0)) {
+    case 0:
+      ret = func (func_data);
+      break;
+
+    case PREEMPTED_BY_CRASH:
+      test_crashed (&context);
+      break;
+  }
+
+  g_private_set (&current_thread, NULL);
+  gtu_log_capture_set_thread (NULL);
+  tr_context_unref (context.tr_context);
+
+  return ret;
+}
+
+GThread* gtu_thread_new (const char* name, GThreadFunc func, void* data) {
+  TestRunContext* tr_context;
+  ThreadStart* start;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  tr_context = _gtu_get_tr_context ();
+  if (tr_context == NULL)
+    return g_thread_new (name, func, data);
+
+  start = g_slice_new (ThreadStart);
+  start->func = func;
+  start->data = data;
+  start->tr_context = tr_context_ref (tr_context);
+  start->capture = gtu_log_capture_get_thread ();
+
+  return g_thread_new (name, &thread_start, start);
+}
+
+void* gtu_thread_join (GThread* thread) {
+  TestRunContext* tr_context;
+  void* ret;
+
+  g_return_val_if_fail (thread != NULL, NULL);
+
+  ret = g_thread_join (thread);
+
+  tr_context = _gtu_get_tr_context ();
+  if (tr_context != NULL) {
+    GtuTestResult result;
+
+    G_LOCK (outcome);
+    result = tr_context->result;
+    G_UNLOCK (outcome);
+
+    if (result != GTU_TEST_RESULT_PASS)
+      PREEMPT_TEST ((ThreadContext*) g_private_get (&current_thread));
+  }
 
   return ret;
 }
@@ -21,9 +21,11 @@ void _gtu_test_case_dispose (GtuTestCase* self) {
   priv->func_target = NULL;
   priv->func_target_destroy = NULL;
 
-  if (priv->expected_msgs) {
-    g_array_free (priv->expected_msgs, true);
-    priv->expected_msgs = NULL;
+  if (priv->expectations) {
+    g_hash_table_unref (priv->expectations->index);
+    g_array_free (priv->expectations->messages, true);
+    g_slice_free (GtuExpectations, priv->expectations);
+    priv->expectations = NULL;
   }
 
   priv->has_disposed = true;
@@ -51,11 +53,10 @@ static void gtu_test_case_class_init (GtuTestCaseClass* klass) {
 static void gtu_test_case_init (GtuTestCase* self) {
   GtuTestCasePrivate* priv = PRIVATE (self);
 
-  priv->expected_msgs = g_array_new (false, true, sizeof (GtuExpectedMessage));
-  g_array_set_clear_func (priv->expected_msgs,
-                          (GDestroyNotify) &_gtu_expected_message_dispose);
+  priv->expectations = NULL;
 
   priv->result = GTU_TEST_RESULT_INVALID;
+  priv->parallel_safe = false;
 
   priv->has_disposed = false;
 }
@@ -128,3 +129,37 @@ GtuTestCase* gtu_test_case_new (const char* name,
 
   return self;
 }
+
+GtuTestCase* _gtu_test_case_new_for_entry (GtuTestSuite* parent,
+                                           const GtuTestTableEntry* entry)
+{
+  GtuTestCase* self;
+  GtuTestCasePrivate* priv;
+  bool constructed;
+
+  /* the entry's name was checked when its table was added */
+  constructed = _gtu_test_case_construct_internal (GTU_TYPE_TEST_CASE,
+                                                   entry->name, &self, &priv);
+  g_assert (constructed);
+
+  priv->func = entry->func;
+  priv->func_target = self;
+  priv->func_target_destroy = NULL;
+  priv->parallel_safe =
+    (entry->flags & GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE) != 0;
+
+  _gtu_test_object_sink (self);
+  _gtu_test_object_set_parent_suite (GTU_TEST_OBJECT (self), parent);
+
+  return self;
+}
+
+void gtu_test_case_set_parallel_safe (GtuTestCase* self, bool parallel_safe) {
+  g_return_if_fail (GTU_IS_TEST_CASE (self));
+  PRIVATE (self)->parallel_safe = parallel_safe;
+}
+
+bool gtu_test_case_get_parallel_safe (GtuTestCase* self) {
+  g_return_val_if_fail (GTU_IS_TEST_CASE (self), false);
+  return PRIVATE (self)->parallel_safe;
+}
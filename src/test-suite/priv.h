@@ -3,6 +3,16 @@
 
 #include "gtu-priv.h"
 
-G_GNUC_INTERNAL int _gtu_test_suite_run_internal (GPtrArray* tests);
+/* `tests' is an array of GtuCollectedTest */
+G_GNUC_INTERNAL int _gtu_test_suite_run_internal (GArray* tests);
+
+G_GNUC_INTERNAL void _gtu_test_suite_set_table (GtuTestSuite* self,
+                                                const GtuTestTable* table);
+
+/* adds `table's tests to `tests', with `cursor' pointing at `suite' */
+G_GNUC_INTERNAL void _gtu_test_table_collect (GtuTestSuite* suite,
+                                              const GtuTestTable* table,
+                                              const GtuSelectorCursor* cursor,
+                                              GArray* tests);
 
 #endif
@@ -1,67 +1,268 @@
 #include <stdio.h>
+#include <string.h>
 #include "test-suite/priv.h"
 #include "log/logio.h"
+#include "log/log-glib.h"
 
-static void run_test (GtuTestCase* test_case, int* n_failed) {
-  char* message = NULL;
-  GtuTestResult result = GTU_TEST_RESULT_INVALID;
-  const GtuPath* path;
-
-  if (_gtu_test_case_has_run (test_case))
-    return;
+/* Runs of consecutive parallel-safe tests are handed to `pool' as a batch,
+   one Job each. Their results are reported in order as they come in, with
+   whatever they logged held back until then. */
+typedef struct {
+  GtuTestCase*      test_case;
+  GtuLogCapture*    capture;
+  GtuTestResult     result;
+  char*             message;
+  GtuLogTestDetails details;
+  bool              done;    /* protected by `batch_lock' */
+} Job;
 
-  path = gtu_test_object_get_path (GTU_TEST_OBJECT (test_case));
-
-  if (_gtu_get_test_mode ()->list_only) {
-    fprintf (stdout, "%s\n", gtu_path_to_string (path));
-    return;
-  }
-
-  if (_gtu_path_should_run (path)) {
-    result = _gtu_test_case_run (test_case, &message);
-
-  } else {
-    result = GTU_TEST_RESULT_SKIP;
-    message = g_strdup ("due to command line args");
-  }
+static GThreadPool* pool = NULL;
+static GMutex batch_lock;
+static GCond batch_done;
 
+static void report_result (const char* path,
+                           GtuTestResult result,
+                           const char* message,
+                           const GtuLogTestDetails* details,
+                           int* n_failed)
+{
   switch (result) {
     case GTU_TEST_RESULT_PASS:
-      gtu_log_test_success (gtu_path_to_string (path), message);
+      gtu_log_test_success (path, message, details);
       break;
 
     case GTU_TEST_RESULT_SKIP:
-      gtu_log_test_skipped (gtu_path_to_string (path), message);
+      gtu_log_test_skipped (path, message, details);
       break;
 
     case GTU_TEST_RESULT_FAIL:
-      gtu_log_test_failed (gtu_path_to_string (path), message);
+      gtu_log_test_failed (path, message, details);
       (*n_failed)++;
       break;
 
     default:
       g_assert_not_reached ();
   }
+}
+
+static const char* get_test_case_path (GtuTestCase* test_case) {
+  return gtu_path_to_string (
+    gtu_test_object_get_path (GTU_TEST_OBJECT (test_case))
+  );
+}
+
+/* a table's test is only given a GtuTestCase to run, and doesn't need one to
+   be listed or skipped */
+static GtuTestCase* collected_test_get_case (GtuCollectedTest* test) {
+  if (test->test_case == NULL)
+    test->test_case = _gtu_test_case_new_for_entry (test->table, test->entry);
+
+  return test->test_case;
+}
+
+static void collected_test_release_case (GtuCollectedTest* test) {
+  if (test->entry != NULL && test->test_case != NULL) {
+    gtu_test_object_unref (test->test_case);
+    test->test_case = NULL;
+  }
+}
+
+static void report_skipped (const GtuCollectedTest* test, int* n_failed) {
+  GtuLogTestDetails details = { 0, 0, 0, 0, false, NULL, NULL, NULL };
+  const char* message = "due to command line args";
+
+  if (test->test_case != NULL) {
+    report_result (get_test_case_path (test->test_case),
+                   GTU_TEST_RESULT_SKIP, message, &details, n_failed);
+  } else {
+    char* path = g_strconcat (
+      gtu_test_object_get_path_string (GTU_TEST_OBJECT (test->table)),
+      "/", test->entry->name, NULL
+    );
+
+    report_result (path, GTU_TEST_RESULT_SKIP, message, &details, n_failed);
+    g_free (path);
+  }
+}
+
+static void list_test (const GtuCollectedTest* test) {
+  if (test->test_case != NULL)
+    fprintf (stdout, "%s\n", get_test_case_path (test->test_case));
+  else
+    fprintf (stdout, "%s/%s\n",
+             gtu_test_object_get_path_string (GTU_TEST_OBJECT (test->table)),
+             test->entry->name);
+}
+
+static void run_test (GtuCollectedTest* test, int* n_failed) {
+  char* message = NULL;
+  GtuTestResult result;
+  GtuLogTestDetails details = { 0, 0, 0, 0, false, NULL, NULL, NULL };
+  GtuTestCase* test_case;
+
+  if (test->test_case != NULL && _gtu_test_case_has_run (test->test_case))
+    return;
+
+  if (_gtu_get_test_mode ()->list_only) {
+    list_test (test);
+    return;
+  }
+
+  if (!test->selected) {
+    report_skipped (test, n_failed);
+    return;
+  }
+
+  test_case = collected_test_get_case (test);
+
+  gtu_log_capture_begin ();
+  result = _gtu_test_case_run (test_case, &message, &details);
+  gtu_log_g_end_test ();
+  gtu_log_capture_end (result != GTU_TEST_RESULT_PASS);
+
+  report_result (get_test_case_path (test_case), result, message, &details,
+                 n_failed);
 
   if (message != NULL)
     g_free (message);
+
+  collected_test_release_case (test);
+}
+
+static void run_job (Job* job, void* user_data) {
+  (void) user_data;
+
+  gtu_log_capture_set_thread (job->capture);
+  gtu_log_g_begin_thread_test ();
+
+  job->result = _gtu_test_case_run (job->test_case, &job->message,
+                                    &job->details);
+
+  gtu_log_g_end_test ();
+  gtu_log_capture_set_thread (NULL);
+
+  g_mutex_lock (&batch_lock);
+  job->done = true;
+  g_cond_broadcast (&batch_done);
+  g_mutex_unlock (&batch_lock);
+}
+
+static bool can_run_in_pool (const GtuCollectedTest* test) {
+  if (pool == NULL || !test->selected)
+    return false;
+
+  /* a table's tests are plain test cases which haven't run yet */
+  if (test->test_case == NULL)
+    return (test->entry->flags & GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE) != 0;
+
+  return gtu_test_case_get_parallel_safe (test->test_case) &&
+         !GTU_IS_COMPLEX_CASE (test->test_case) &&
+         !_gtu_test_case_has_run (test->test_case);
+}
+
+/* Jobs each hold a test case and its capture until they're reported, so only
+   this many per thread are given to the pool at once. */
+#define JOBS_PER_THREAD 2
+
+static void push_job (Job* job, GtuCollectedTest* test) {
+  memset (job, 0, sizeof (Job));
+  job->test_case = collected_test_get_case (test);
+
+  /* paths are built lazily, and the jobs would otherwise all build the parts
+     they share at once */
+  get_test_case_path (job->test_case);
+
+  job->capture = gtu_log_capture_new ();
+  g_thread_pool_push (pool, job, NULL);
+}
+
+/* every test in `tests' is selected */
+static void run_batch (GtuCollectedTest* tests, unsigned n_tests,
+                       int* n_failed)
+{
+  unsigned n_slots = JOBS_PER_THREAD *
+                     (unsigned) g_thread_pool_get_max_threads (pool);
+  Job* jobs = g_new (Job, n_slots);
+  unsigned n_pushed = 0;
+  unsigned i;
+
+  for (i = 0; i < n_tests; i++) {
+    Job* job = &jobs[i % n_slots];
+
+    /* a job's slot is free again once it's been reported */
+    for (; n_pushed < n_tests && n_pushed < i + n_slots; n_pushed++)
+      push_job (&jobs[n_pushed % n_slots], &tests[n_pushed]);
+
+    g_mutex_lock (&batch_lock);
+    while (!job->done)
+      g_cond_wait (&batch_done, &batch_lock);
+    g_mutex_unlock (&batch_lock);
+
+    /* the result has to come after its diagnostics */
+    gtu_log_capture_finish (job->capture, job->result != GTU_TEST_RESULT_PASS);
+
+    report_result (get_test_case_path (job->test_case), job->result,
+                   job->message, &job->details, n_failed);
+
+    g_free (job->message);
+    collected_test_release_case (&tests[i]);
+  }
+
+  g_free (jobs);
 }
 
-static void count_tests (GtuTestCase* test_case, unsigned* n_tests) {
-  if (GTU_IS_COMPLEX_CASE (test_case)) {
-    *n_tests += _gtu_complex_case_get_length (GTU_COMPLEX_CASE (test_case));
+static unsigned count_tests (GArray* tests) {
+  unsigned n_tests = 0;
+  unsigned i;
+
+  for (i = 0; i < tests->len; i++) {
+    GtuTestCase* test_case = g_array_index (tests, GtuCollectedTest,
+                                            i).test_case;
+
+    if (test_case != NULL && GTU_IS_COMPLEX_CASE (test_case))
+      n_tests += _gtu_complex_case_get_length (GTU_COMPLEX_CASE (test_case));
+
+    n_tests++;
   }
 
-  (*n_tests)++;
+  return n_tests;
 }
 
-int _gtu_test_suite_run_internal (GPtrArray* tests) {
+int _gtu_test_suite_run_internal (GArray* tests) {
   int n_failed = 0;
-  unsigned n_tests = 0;
+  unsigned n_jobs = _gtu_get_test_mode ()->n_jobs;
+  unsigned i = 0;
+
+  gtu_log_test_plan (count_tests (tests));
+
+  if (n_jobs == 0)
+    n_jobs = g_get_num_processors ();
+
+  if (n_jobs > 1 && !_gtu_get_test_mode ()->list_only)
+    pool = g_thread_pool_new ((GFunc) &run_job, NULL, (int) n_jobs, false,
+                              NULL);
 
-  g_ptr_array_foreach (tests, (GFunc) &count_tests, &n_tests);
-  gtu_log_test_plan (n_tests);
+  while (i < tests->len) {
+    GtuCollectedTest* batch = &g_array_index (tests, GtuCollectedTest, i);
+    unsigned batch_length = 0;
+
+    while (i + batch_length < tests->len &&
+           can_run_in_pool (&batch[batch_length]))
+      batch_length++;
+
+    if (batch_length > 0) {
+      run_batch (batch, batch_length, &n_failed);
+      i += batch_length;
+    } else {
+      run_test (batch, &n_failed);
+      i++;
+    }
+  }
+
+  if (pool != NULL) {
+    g_thread_pool_free (pool, false, true);
+    pool = NULL;
+  }
 
-  g_ptr_array_foreach (tests, (GFunc) &run_test, &n_failed);
   return n_failed;
 }
@@ -0,0 +1,100 @@
+#include <string.h>
+#include "test-suite/priv.h"
+
+/* GTU_TEST_TABLE() puts a pointer to each table in the gtu_test_tables
+   section, and the linker brackets the section with these. They're weak so a
+   program without any tables still links. */
+#if defined (__GNUC__) && defined (__ELF__)
+# define HAVE_LINKED_TABLES
+extern const GtuTestTable* const __start_gtu_test_tables[]
+  __attribute__ ((weak));
+extern const GtuTestTable* const __stop_gtu_test_tables[]
+  __attribute__ ((weak));
+#endif
+
+static bool table_is_valid (const GtuTestTable* table) {
+  size_t i;
+
+  if (!_gtu_path_element_is_valid (table->name))
+    return false;
+
+  for (i = 0; i < table->n_entries; i++)
+    if (!_gtu_path_element_is_valid (table->entries[i].name) ||
+        table->entries[i].func == NULL)
+    {
+      return false;
+    }
+
+  return true;
+}
+
+void gtu_test_suite_add_table (GtuTestSuite* self, const GtuTestTable* table) {
+  GtuTestSuite* table_suite;
+
+  g_return_if_fail (GTU_IS_TEST_SUITE (self));
+  g_return_if_fail (table != NULL && table_is_valid (table));
+
+  table_suite = gtu_test_suite_new (table->name);
+  _gtu_test_suite_set_table (table_suite, table);
+
+  gtu_test_suite_add_obj (self, table_suite);
+}
+
+#ifdef HAVE_LINKED_TABLES
+static int compare_tables (const void* a, const void* b) {
+  return strcmp ((*(const GtuTestTable* const*) a)->name,
+                 (*(const GtuTestTable* const*) b)->name);
+}
+#endif
+
+void gtu_test_suite_add_tables (GtuTestSuite* self) {
+#ifdef HAVE_LINKED_TABLES
+  const GtuTestTable** tables;
+  size_t n_tables, i;
+
+  g_return_if_fail (GTU_IS_TEST_SUITE (self));
+
+  if (__start_gtu_test_tables == NULL)
+    return;
+
+  n_tables = __stop_gtu_test_tables - __start_gtu_test_tables;
+  tables = g_new (const GtuTestTable*, n_tables);
+
+  memcpy (tables, __start_gtu_test_tables,
+          n_tables * sizeof (const GtuTestTable*));
+  qsort (tables, n_tables, sizeof (const GtuTestTable*), &compare_tables);
+
+  for (i = 0; i < n_tables; i++)
+    gtu_test_suite_add_table (self, tables[i]);
+
+  g_free (tables);
+#else
+  g_return_if_fail (GTU_IS_TEST_SUITE (self));
+
+  g_log (GTU_LOG_DOMAIN, G_LOG_LEVEL_CRITICAL,
+         "GTU_TEST_TABLE() isn't supported on this platform; "
+         "use gtu_test_suite_add_table() instead");
+#endif
+}
+
+void _gtu_test_table_collect (GtuTestSuite* suite,
+                              const GtuTestTable* table,
+                              const GtuSelectorCursor* cursor,
+                              GArray* tests)
+{
+  size_t i;
+
+  for (i = 0; i < table->n_entries; i++) {
+    GtuCollectedTest test = { NULL, NULL, NULL, false };
+    GtuSelectorCursor entry_cursor = *cursor;
+
+    /* the names aren't interned, which would cost us an allocation each */
+    _gtu_selector_cursor_step_name (&entry_cursor, table->entries[i].name);
+
+    test.table = suite;
+    test.entry = &table->entries[i];
+    test.selected = _gtu_selector_cursor_should_run (&entry_cursor);
+
+    g_array_append_val (tests, test);
+  }
+}
@@ -3,7 +3,8 @@
 
 typedef struct {
   GPtrArray*              children;
-  GHashTable*             child_names;  /* set containing unowned strings */
+  GHashTable*             child_names;  /* set of name quarks */
+  const GtuTestTable*     table;        /* if made for one */
 } GtuTestSuitePrivate;
 
 #define PRIVATE(obj) \
@@ -29,7 +30,9 @@ void gtu_test_suite_add (GtuTestSuite* self, GtuTestObject* test_object) {
   /* ght_add returns TRUE if the insertion is unique */
   g_return_if_fail (
     g_hash_table_add (priv->child_names,
-                      (void*) gtu_test_object_get_name (test_object))
+                      GUINT_TO_POINTER (
+                        _gtu_test_object_get_name_quark (test_object)
+                      ))
   );
 
   child = gtu_test_object_ref_sink (test_object);
@@ -37,15 +40,49 @@ void gtu_test_suite_add (GtuTestSuite* self, GtuTestObject* test_object) {
   _gtu_test_object_set_parent_suite (child, self);
 }
 
-void _gtu_test_object_collect_tests (GtuTestObject* object, GPtrArray* tests) {
+void _gtu_test_suite_set_table (GtuTestSuite* self,
+                                const GtuTestTable* table)
+{
+  g_assert (GTU_IS_TEST_SUITE (self));
+  PRIVATE (self)->table = table;
+}
+
+void _gtu_test_object_collect_tests (GtuTestObject* object,
+                                     const GtuSelectorCursor* parent_cursor,
+                                     GArray* tests)
+{
+  GtuSelectorCursor cursor = *parent_cursor;
+
   g_assert (GTU_IS_TEST_OBJECT (object));
 
+  /* a no-op once the suite's fate has been decided, so whole subtrees are
+     selected or skipped at once */
+  _gtu_selector_cursor_step (&cursor, _gtu_test_object_get_name_quark (object));
+
   if (GTU_IS_TEST_CASE (object)) {
-    g_ptr_array_add (tests, GTU_TEST_CASE (object));
+    GtuCollectedTest test = { NULL, NULL, NULL, false };
+
+    test.test_case = GTU_TEST_CASE (object);
+
+    /* a complex case runs if any of its subunits do */
+    if (GTU_IS_COMPLEX_CASE (object))
+      test.selected = _gtu_complex_case_select_subunits (
+        GTU_COMPLEX_CASE (object), &cursor
+      );
+    else
+      test.selected = _gtu_selector_cursor_should_run (&cursor);
+    g_array_append_val (tests, test);
 
   } else if (GTU_IS_TEST_SUITE (object)) {
-    g_ptr_array_foreach (PRIVATE (object)->children,
-                         (GFunc) _gtu_test_object_collect_tests, tests);
+    GPtrArray* children = PRIVATE (object)->children;
+    unsigned i;
+
+    for (i = 0; i < children->len; i++)
+      _gtu_test_object_collect_tests (children->pdata[i], &cursor, tests);
+
+    if (PRIVATE (object)->table != NULL)
+      _gtu_test_table_collect (GTU_TEST_SUITE (object),
+                               PRIVATE (object)->table, &cursor, tests);
 
   } else {
     g_log (GTU_LOG_DOMAIN, G_LOG_LEVEL_CRITICAL,
@@ -55,7 +92,8 @@ void _gtu_test_object_collect_tests (GtuTestObject* object, GPtrArray* tests) {
 }
 
 int gtu_test_suite_run (GtuTestSuite* self) {
-  GPtrArray* tests;
+  GArray* tests;
+  GtuSelectorCursor cursor;
   int ret;
 
   static bool has_run = false;
@@ -68,12 +106,13 @@ int gtu_test_suite_run (GtuTestSuite* self) {
 
   _gtu_test_object_sink (self);
 
-  tests = g_ptr_array_new ();
-  _gtu_test_object_collect_tests (GTU_TEST_OBJECT (self), tests);
+  tests = g_array_new (false, false, sizeof (GtuCollectedTest));
+  _gtu_selector_cursor_init (&cursor);
+  _gtu_test_object_collect_tests (GTU_TEST_OBJECT (self), &cursor, tests);
 
   ret = _gtu_test_suite_run_internal (tests);
 
-  g_ptr_array_free (tests, true);
+  g_array_free (tests, true);
   gtu_test_object_unref (GTU_TEST_OBJECT (self));
 
   has_run = true;
@@ -97,28 +136,12 @@ static void gtu_test_suite_class_init (GtuTestSuiteClass* klass) {
   GTU_TEST_OBJECT_CLASS (klass)->finalize = gtu_test_suite_finalize;
 }
 
-static void propagate_signal (GtuTestSuite* self, void* data) {
-  unsigned i;
-  GtuTestSuitePrivate* priv;
-
-  (void) data;
-
-  priv = PRIVATE (self);
-  for (i = 0; i < priv->children->len; i++)
-    _gtu_test_object_emit_ancestry_signal (
-      GTU_TEST_OBJECT (priv->children->pdata[i])
-    );
-}
-
 static void gtu_test_suite_init (GtuTestSuite* self) {
   GtuTestSuitePrivate* priv = PRIVATE (self);
 
   priv->children = g_ptr_array_new_with_free_func (&gtu_test_object_unref);
-  priv->child_names = g_hash_table_new (&g_str_hash, &g_str_equal);
-
-  g_signal_connect (self,
-                    "ancestry-changed",
-                    (GCallback) &propagate_signal, NULL);
+  priv->child_names = g_hash_table_new (NULL, NULL);
+  priv->table = NULL;
 }
 
 GtuTestSuite* gtu_test_suite_construct (GType type, const char* name) {
@@ -0,0 +1,71 @@
+#include <string.h>
+#include "gtu.h"
+
+/* measures how many tests a second can fail by logging an unexpected warning,
+   which is the path negative tests take through the log hooks' stack
+   unwinding. Run with -m perf. Every test but the last is meant to fail, so
+   --keep-going is always added to the arguments; without it the first
+   failure would bail out of the whole run. */
+
+#define BENCH_DOMAIN "Bench"
+#define N_FAILURES   (10 * 1000)
+
+static gint64 start = 0;
+
+static void fail_test (void* data) {
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+
+  if (start == 0)
+    start = g_get_monotonic_time ();
+
+  g_log (BENCH_DOMAIN, G_LOG_LEVEL_WARNING, "failing on purpose");
+  gtu_assert_not_reached ();
+}
+
+static void report_test (void* data) {
+  gint64 end = g_get_monotonic_time ();
+
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+
+  g_message ("%d failing tests: %.1f us per test, %.0f tests per second",
+             N_FAILURES, (end - start) / (double) N_FAILURES,
+             N_FAILURES * 1e6 / (end - start));
+}
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+  GtuTestSuite* failures;
+  char** args;
+  int i;
+
+  args = g_new (char*, argc + 2);
+  memcpy (args, argv, argc * sizeof (char*));
+  args[argc] = "--keep-going";
+  args[argc + 1] = NULL;
+
+  gtu_init (args, argc + 1);
+
+  suite = gtu_test_suite_new ("bench-abort");
+  failures = gtu_test_suite_new ("failures");
+
+  for (i = 0; i < N_FAILURES; i++) {
+    char name[32];
+
+    g_snprintf (name, sizeof (name), "fail-%d", i);
+    gtu_test_suite_add_obj (failures, gtu_test_case_new (name, fail_test,
+                                                         NULL, NULL));
+  }
+
+  gtu_test_suite_add_obj (suite, failures);
+  gtu_test_suite_add_obj (suite, gtu_test_case_new ("report", report_test,
+                                                    NULL, NULL));
+
+  /* the failures are the point, so don't report them as ours */
+  gtu_test_suite_run (suite);
+  g_free (args);
+  return 0;
+}
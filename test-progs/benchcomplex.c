@@ -0,0 +1,104 @@
+#include "gtu.h"
+
+/* a complex case whose subunits are independent, each waiting a while as if
+   talking to a slow peer. With concurrent_subunits set, the whole case should
+   take about as long as one subunit given enough processors; compare with
+   `-j 1', which runs them one after another. */
+
+#define SUBUNIT_DURATION_US (100 * 1000)
+
+typedef enum {
+  CODEC_RAW,
+  CODEC_GZIP,
+  CODEC_BZIP2,
+  CODEC_XZ,
+  CODEC_LZ4,
+  CODEC_ZSTD,
+  CODEC_BROTLI,
+  CODEC_SNAPPY,
+  CODEC_LZO,
+  CODEC_LZMA,
+  CODEC_DEFLATE,
+  CODEC_ZLIB,
+  CODEC_LZF,
+  CODEC_LZHAM,
+  CODEC_DENSITY,
+  CODEC_SKIPPED
+} Codec;
+
+static GType codec_get_type (void) {
+  static const GEnumValue values[] = {
+    { CODEC_RAW,     "CODEC_RAW",     "raw" },
+    { CODEC_GZIP,    "CODEC_GZIP",    "gzip" },
+    { CODEC_BZIP2,   "CODEC_BZIP2",   "bzip2" },
+    { CODEC_XZ,      "CODEC_XZ",      "xz" },
+    { CODEC_LZ4,     "CODEC_LZ4",     "lz4" },
+    { CODEC_ZSTD,    "CODEC_ZSTD",    "zstd" },
+    { CODEC_BROTLI,  "CODEC_BROTLI",  "brotli" },
+    { CODEC_SNAPPY,  "CODEC_SNAPPY",  "snappy" },
+    { CODEC_LZO,     "CODEC_LZO",     "lzo" },
+    { CODEC_LZMA,    "CODEC_LZMA",    "lzma" },
+    { CODEC_DEFLATE, "CODEC_DEFLATE", "deflate" },
+    { CODEC_ZLIB,    "CODEC_ZLIB",    "zlib" },
+    { CODEC_LZF,     "CODEC_LZF",     "lzf" },
+    { CODEC_LZHAM,   "CODEC_LZHAM",   "lzham" },
+    { CODEC_DENSITY, "CODEC_DENSITY", "density" },
+    { CODEC_SKIPPED, "CODEC_SKIPPED", "skipped" },
+    { 0, NULL, NULL }
+  };
+  static GType type = 0;
+
+  if (type == 0)
+    type = g_enum_register_static ("BenchComplexCodec", values);
+
+  return type;
+}
+
+typedef struct {
+  GtuComplexCase parent_instance;
+} CodecCase;
+
+typedef struct {
+  GtuComplexCaseClass parent_class;
+} CodecCaseClass;
+
+static GType codec_case_get_type (void);
+G_DEFINE_TYPE (CodecCase, codec_case, GTU_TYPE_COMPLEX_CASE)
+
+static void codec_case_test_impl (GtuComplexCase* self, gconstpointer subunit) {
+  Codec codec = GPOINTER_TO_INT (subunit);
+
+  (void) self;
+
+  g_usleep (SUBUNIT_DURATION_US);
+
+  if (codec == CODEC_SKIPPED)
+    gtu_skip_if_reached ("not built with this codec");
+
+  g_message ("round trip through %s done",
+             g_enum_get_value (g_type_class_peek (codec_get_type ()),
+                               codec)->value_nick);
+}
+
+static void codec_case_init (CodecCase* self) {
+  (void) self;
+}
+
+static void codec_case_class_init (CodecCaseClass* klass) {
+  GTU_COMPLEX_CASE_CLASS (klass)->test_impl = &codec_case_test_impl;
+  GTU_COMPLEX_CASE_CLASS (klass)->concurrent_subunits = true;
+}
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+
+  gtu_init (argv, argc);
+
+  suite = gtu_test_suite_new ("bench-complex");
+  gtu_test_suite_add_obj (suite,
+                          gtu_complex_case_construct (codec_case_get_type (),
+                                                      "codecs",
+                                                      codec_get_type ()));
+
+  return gtu_test_suite_run (suite);
+}
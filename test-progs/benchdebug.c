@@ -0,0 +1,78 @@
+#include "gtu.h"
+
+/* measures what g_debug() costs in code that logs a lot of it, when nothing
+   is going to be printed. Run with -m perf. */
+
+#define BENCH_DOMAIN "Bench"
+#define ITERATIONS   (1000 * 1000)
+
+/* test functions only get their target, so the ones which need their test
+   case to add expectations find it here */
+static GtuTestCase* interest_case = NULL;
+static GtuTestCase* expected_case = NULL;
+
+static void run_bench (const char* description) {
+  gint64 start, end;
+  int i;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < ITERATIONS; i++)
+    g_log (BENCH_DOMAIN, G_LOG_LEVEL_DEBUG, "iteration %d of %d", i, ITERATIONS);
+
+  end = g_get_monotonic_time ();
+
+  g_message ("%s: %.1f ns per message",
+             description, (end - start) * 1000.0 / ITERATIONS);
+}
+
+static void dropped_test (void* data) {
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+  run_bench ("debug, no expectations");
+}
+
+static void dropped_interest_test (void* data) {
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+
+  /* an expectation in another domain costs us a table lookup per message */
+  gtu_test_case_expect_message (interest_case, "Elsewhere", G_LOG_LEVEL_DEBUG,
+                                g_regex_new ("^never$", 0, 0, NULL));
+
+  run_bench ("debug, expectation in another domain");
+}
+
+static void expected_test (void* data) {
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+
+  /* all the way through the hooks */
+  gtu_test_case_expect_message (expected_case, BENCH_DOMAIN, G_LOG_LEVEL_DEBUG,
+                                g_regex_new ("^never$", 0, 0, NULL));
+
+  run_bench ("debug, expectation in the same domain");
+}
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+
+  gtu_init (argv, argc);
+
+  suite = gtu_test_suite_new ("bench-debug");
+
+  gtu_test_suite_add_obj (suite, gtu_test_case_new ("dropped", dropped_test,
+                                                    NULL, NULL));
+
+  interest_case = gtu_test_case_new ("dropped-interest", dropped_interest_test,
+                                     NULL, NULL);
+  gtu_test_suite_add_obj (suite, interest_case);
+
+  expected_case = gtu_test_case_new ("expected", expected_test, NULL, NULL);
+  gtu_test_suite_add_obj (suite, expected_case);
+
+  return gtu_test_suite_run (suite);
+}
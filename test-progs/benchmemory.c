@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "gtu.h"
+
+/* measures how much memory registering a test costs, by building a suite
+   shaped like a generated one (N_SUITES suites of N_CASES tests each) and
+   watching the resident set grow. Run with -m perf; it needs /proc. */
+
+#define N_SUITES 1000
+#define N_CASES  1000
+#define N_TESTS  (N_SUITES * N_CASES)
+
+static long get_resident_bytes (void) {
+  FILE* statm = fopen ("/proc/self/statm", "r");
+  long size, resident;
+
+  if (statm == NULL)
+    return -1;
+
+  if (fscanf (statm, "%ld %ld", &size, &resident) != 2)
+    resident = -1;
+
+  fclose (statm);
+
+  return resident < 0 ? -1 : resident * sysconf (_SC_PAGESIZE);
+}
+
+static void dummy_test (void* data) {
+  (void) data;
+}
+
+static void report_test (void* data) {
+  GtuTestSuite* root;
+  GtuTestCase** cases;
+  long before, registered, with_paths;
+  int i, j;
+
+  (void) data;
+
+  gtu_skip_if_not_perf ();
+
+  /* filled in ahead of time, so keeping hold of the tests isn't counted */
+  cases = g_new (GtuTestCase*, N_TESTS);
+  memset (cases, 0, N_TESTS * sizeof (GtuTestCase*));
+
+  before = get_resident_bytes ();
+  gtu_skip_if_fail (before >= 0, "Can't read /proc/self/statm");
+
+  root = gtu_test_suite_new ("generated");
+
+  for (i = 0; i < N_SUITES; i++) {
+    GtuTestSuite* suite;
+    char name[32];
+
+    g_snprintf (name, sizeof (name), "suite-%d", i);
+    suite = gtu_test_suite_new (name);
+
+    for (j = 0; j < N_CASES; j++) {
+      g_snprintf (name, sizeof (name), "test-%d", j);
+      cases[i * N_CASES + j] = gtu_test_case_new (name, dummy_test,
+                                                  NULL, NULL);
+      gtu_test_suite_add_obj (suite, cases[i * N_CASES + j]);
+    }
+
+    gtu_test_suite_add_obj (root, suite);
+  }
+
+  registered = get_resident_bytes ();
+
+  for (i = 0; i < N_TESTS; i++)
+    gtu_test_object_get_path (GTU_TEST_OBJECT (cases[i]));
+
+  with_paths = get_resident_bytes ();
+
+  g_message ("%d tests: %.0f bytes per registered test, "
+             "%.0f with its path built",
+             N_TESTS, (registered - before) / (double) N_TESTS,
+             (with_paths - before) / (double) N_TESTS);
+
+  gtu_test_object_unref (root);
+  g_free (cases);
+}
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+
+  gtu_init (argv, argc);
+
+  suite = gtu_test_suite_new ("bench-memory");
+  gtu_test_suite_add_obj (suite, gtu_test_case_new ("report", report_test,
+                                                    NULL, NULL));
+
+  return gtu_test_suite_run (suite);
+}
@@ -77,6 +77,52 @@ static void run_second (void* data) {
   g_message ("run second");
 }
 
+static void* helper_pass (void* data) {
+  gtu_assert (GPOINTER_TO_INT (data) == 23);
+  return data;
+}
+
+static void* helper_fail (void* data) {
+  (void) data;
+  gtu_assert_not_reached ();
+  g_assert_not_reached ();
+}
+
+static void* helper_skip (void* data) {
+  (void) data;
+  gtu_skip_if_reached ("skipped from a helper thread");
+  g_assert_not_reached ();
+}
+
+static void thread_test (void* data) {
+  GThread* thread;
+
+  (void) data;
+
+  thread = gtu_thread_new ("helper", helper_pass, GINT_TO_POINTER (23));
+  gtu_assert (gtu_thread_join (thread) == GINT_TO_POINTER (23));
+}
+
+static void thread_fail_test (void* data) {
+  GThread* thread;
+
+  (void) data;
+
+  thread = gtu_thread_new ("helper", helper_fail, NULL);
+  gtu_thread_join (thread);
+  g_assert_not_reached ();
+}
+
+static void thread_skip_test (void* data) {
+  GThread* thread;
+
+  (void) data;
+
+  thread = gtu_thread_new ("helper", helper_skip, NULL);
+  gtu_thread_join (thread);
+  g_assert_not_reached ();
+}
+
 int main (int argc, char* argv[]) {
   GtuTestSuite* suite;
 
@@ -97,6 +143,10 @@ int main (int argc, char* argv[]) {
                                                     GINT_TO_POINTER (42),
                                                     _destroy));
 
+  ASSERT_TEST (suite, thread);
+  ASSERT_TEST (suite, thread_fail);
+  ASSERT_TEST (suite, thread_skip);
+
   gtu_test_suite_add_obj (suite, gtu_test_case_new ("first", run_first,
                                                     NULL, NULL));
 
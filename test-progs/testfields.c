@@ -0,0 +1,84 @@
+#include "gtu.h"
+
+/* expectations matching the fields of structured log messages */
+
+#define DOMAIN "Fields"
+
+static void exact_test (void* data) {
+  GtuTestCase* self = data;
+  GtuExpectHandle handle;
+
+  handle = gtu_test_case_expect_field (self, DOMAIN, G_LOG_LEVEL_WARNING,
+                                       "CODE", "E42");
+
+  g_log_structured (DOMAIN, G_LOG_LEVEL_WARNING,
+                    "CODE", "E42",
+                    "MESSAGE", "request %d failed", 7);
+
+  gtu_assert (gtu_test_case_expect_check (self, handle));
+}
+
+static void prefix_test (void* data) {
+  GtuTestCase* self = data;
+  GtuExpectHandle handle;
+
+  handle = gtu_test_case_expect_field_prefix (self, DOMAIN,
+                                              G_LOG_LEVEL_WARNING,
+                                              "PATH", "/usr/");
+
+  g_log_structured (DOMAIN, G_LOG_LEVEL_WARNING,
+                    "PATH", "/usr/lib/libfoo.so",
+                    "MESSAGE", "couldn't load module");
+
+  gtu_assert (gtu_test_case_expect_check (self, handle));
+}
+
+static void range_test (void* data) {
+  GtuTestCase* self = data;
+  GtuExpectHandle handle;
+
+  handle = gtu_test_case_expect_field_range (self, DOMAIN,
+                                             G_LOG_LEVEL_WARNING,
+                                             "SIZE", 10, 20);
+
+  g_log_structured (DOMAIN, G_LOG_LEVEL_WARNING,
+                    "SIZE", "15",
+                    "MESSAGE", "short read");
+
+  gtu_assert (gtu_test_case_expect_count (self, handle) == 1);
+}
+
+static void no_message_test (void* data) {
+  GtuTestCase* self = data;
+  GtuExpectHandle handle;
+  const GLogField fields[] = {
+    { "GLIB_DOMAIN", DOMAIN, -1 },
+    { "CODE",        "E43",  -1 }
+  };
+
+  handle = gtu_test_case_expect_field (self, DOMAIN, G_LOG_LEVEL_WARNING,
+                                       "CODE", "E43");
+
+  g_log_structured_array (G_LOG_LEVEL_WARNING, fields,
+                          G_N_ELEMENTS (fields));
+
+  gtu_assert (gtu_test_case_expect_check (self, handle));
+}
+
+GTU_TEST_TABLE (fields,
+  { "exact",      exact_test,      GTU_TEST_TABLE_FLAGS_NONE },
+  { "prefix",     prefix_test,     GTU_TEST_TABLE_FLAGS_NONE },
+  { "range",      range_test,      GTU_TEST_TABLE_FLAGS_NONE },
+  { "no-message", no_message_test, GTU_TEST_TABLE_FLAGS_NONE }
+);
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+
+  gtu_init (argv, argc);
+
+  suite = gtu_test_suite_new ("gtu-fields");
+  gtu_test_suite_add_table (suite, &fields);
+
+  return gtu_test_suite_run (suite);
+}
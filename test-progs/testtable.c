@@ -0,0 +1,55 @@
+#include "gtu.h"
+
+/* tests declared as static tables rather than built in main() */
+
+static void pass_test (void* data) {
+  (void) data;
+  gtu_assert (TRUE);
+}
+
+static void fail_test (void* data) {
+  (void) data;
+  gtu_assert_not_reached ();
+}
+
+static void skip_test (void* data) {
+  (void) data;
+  gtu_skip_if_reached ("skipped from a table");
+}
+
+static void expect_test (void* data) {
+  GtuTestCase* self = data;
+  GtuExpectHandle handle;
+
+  handle = gtu_test_case_expect_pattern (self, "Table",
+                                         G_LOG_LEVEL_WARNING,
+                                         "expected *",
+                                         GTU_PATTERN_KIND_GLOB);
+
+  g_log ("Table", G_LOG_LEVEL_WARNING, "expected warning");
+  gtu_assert (gtu_test_case_expect_check (self, handle));
+}
+
+GTU_TEST_TABLE (basic,
+  { "pass",   pass_test,   GTU_TEST_TABLE_FLAGS_NONE },
+  { "fail",   fail_test,   GTU_TEST_TABLE_FLAGS_NONE },
+  { "skip",   skip_test,   GTU_TEST_TABLE_FLAGS_NONE },
+  { "expect", expect_test, GTU_TEST_TABLE_FLAGS_NONE }
+);
+
+GTU_TEST_TABLE (parallel,
+  { "first",  pass_test, GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE },
+  { "second", pass_test, GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE },
+  { "third",  pass_test, GTU_TEST_TABLE_FLAGS_PARALLEL_SAFE }
+);
+
+int main (int argc, char* argv[]) {
+  GtuTestSuite* suite;
+
+  gtu_init (argv, argc);
+
+  suite = gtu_test_suite_new ("gtu-table");
+  gtu_test_suite_add_tables (suite);
+
+  return gtu_test_suite_run (suite);
+}